@@ -14,12 +14,34 @@ typedef struct {
 	uint64_t guard;
 	void *map;
 	size_t size;
+	uint64_t torn_cnt; /* reads of this reader the writer overwrote, see shm_map_fetch() */
 } shm_t;
 
 bool shm_map_init(const char name[], size_t size);
 
 bool shm_map_open(const char name[], shm_t *shm);
 
+/*
+ * The current copy in place. The writer gets to the same slot again after SHM_COPIES writes
+ * and may change it while it is read, use shm_map_fetch() instead
+ */
 int32_t shm_map_read(shm_t *shm, void **data);
 
+/*
+ * The writer never waits for the readers
+ */
 int32_t shm_map_write(shm_t *shm, void *data, size_t size);
+
+/*
+ * Copies the current data, size bytes at most, and gives its write index if index is not
+ * NULL. A copy the writer overwrote is taken again and counted in torn_cnt. Returns -1 if
+ * every try was overwritten
+ */
+int32_t shm_map_fetch(shm_t *shm, void *data, size_t size, uint32_t *index);
+
+/*
+ * Sleeps until the writer publishes a write index other than last_index (the one
+ * shm_map_fetch() gave), timeout ms at most, -1 waits forever. Returns 1 if there is new
+ * data, 0 on timeout and -1 on error
+ */
+int32_t shm_map_wait(shm_t *shm, uint32_t last_index, int timeout);
@@ -0,0 +1,70 @@
+/**
+ * @file shm_ring.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Очередь в общей памяти, один писатель и один читатель
+ */
+
+#pragma once
+
+#include <svc/platform.h>
+
+typedef struct {
+	uint64_t guard;
+	void *map;
+	size_t slot_size; /* bytes a slot takes at most */
+	size_t slots;
+	int efd; /* readable when the writer has notified, see shm_ring_notify() */
+} shm_ring_t;
+
+/*
+ * Creates the ring of slots (rounded up to a power of two) of slot_size bytes. The wakeup
+ * eventfd is created here as well, so this must be done before the services are forked
+ */
+bool shm_ring_init(const char name[], size_t slot_size, size_t slots);
+
+bool shm_ring_open(const char name[], shm_ring_t *ring);
+
+/*
+ * Writer: a free slot to fill, NULL if the ring is full (counted as dropped)
+ */
+void *shm_ring_reserve(shm_ring_t *ring);
+
+/*
+ * Writer: publishes the slot reserved last with size bytes of data
+ */
+void shm_ring_commit(shm_ring_t *ring, size_t size);
+
+/*
+ * Writer: wakes the reader up, once for all the slots committed since the last time
+ */
+void shm_ring_notify(shm_ring_t *ring);
+
+/*
+ * Reader: the oldest slot, NULL if the ring is empty. It stays valid until shm_ring_pop()
+ */
+const void *shm_ring_front(shm_ring_t *ring, size_t *size);
+
+/*
+ * Reader: the slot offset slots after the oldest one, NULL if there are not so many. Lets
+ * the reader take several slots before popping them
+ */
+const void *shm_ring_peek(shm_ring_t *ring, size_t offset, size_t *size);
+
+void shm_ring_pop(shm_ring_t *ring);
+
+/*
+ * Reader: clears the wakeup. Check the ring again after it, the writer may have just
+ * committed
+ */
+void shm_ring_ack(shm_ring_t *ring);
+
+int shm_ring_fd(const shm_ring_t *ring);
+
+/*
+ * Slots committed and not popped yet
+ */
+size_t shm_ring_count(const shm_ring_t *ring);
+
+uint64_t shm_ring_dropped(const shm_ring_t *ring);
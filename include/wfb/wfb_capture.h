@@ -0,0 +1,49 @@
+/**
+ * @file wfb_capture.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Общий прием с адаптеров и разбор по портам
+ */
+
+#pragma once
+
+#include <svc/shm_ring.h>
+#include <wfb/wfb_rx.h>
+
+#define WFB_CAPTURE_MAX_PORTS (8U)
+
+/* frames moved between two wakeups of the readers at most */
+#define WFB_CAPTURE_BUDGET (64U)
+
+typedef struct {
+	int port;
+	size_t slots; /* frames the ring of every adapter holds */
+} wfb_capture_port_t;
+
+typedef struct {
+	wfb_rx_t wfb_rx; /* every adapter opened once, for all the ports */
+	const wfb_capture_port_t *port;
+	size_t port_count;
+	shm_ring_t ring[WFB_CAPTURE_MAX_PORTS][NL_MAX_IFACES];
+	uint32_t notify[WFB_CAPTURE_MAX_PORTS]; /* adapters with frames the reader is not told of */
+	size_t foreign_cnt;			/* frames of ports nobody reads */
+} wfb_capture_t;
+
+/*
+ * Creates the rings of the ports, one per adapter. Called before the services are started,
+ * the readers open theirs with the WFB_RX_BACKEND_SHARED backend
+ */
+int wfb_capture_init(const wfb_capture_port_t ports[], size_t count);
+
+/*
+ * Opens every adapter with the given backend and the rings of the ports
+ */
+int wfb_capture_open(wfb_capture_t *cap, const wfb_capture_port_t ports[], size_t count,
+		     wfb_rx_backend_t backend);
+
+/*
+ * Moves the frames the adapters have into the rings of their ports, WFB_CAPTURE_BUDGET at
+ * most, and wakes the readers up. Returns the number of frames or -1
+ */
+int wfb_capture(wfb_capture_t *cap);
@@ -0,0 +1,33 @@
+/**
+ * @file wfb_fec.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Параметры FEC потока wifi broadcast
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* limits of a single block, both for data and for fec packets */
+#define WFB_FEC_MAX_PACKETS (32U)
+#define WFB_FEC_MAX_PACKET_LENGTH (2278U)
+
+/*
+ * FEC profile of a stream. Transmitted in every packet header, so the receiver
+ * follows changes without any configuration.
+ */
+typedef struct {
+	size_t data_packets;  /* data packets per block */
+	size_t fec_packets;   /* fec packets per block, may be 0 */
+	size_t packet_length; /* fec block length, including payload header */
+} wfb_fec_profile_t;
+
+#define WFB_FEC_PROFILE_DEFAULT                                                                    \
+	{                                                                                          \
+		.data_packets = 8U, .fec_packets = 4U, .packet_length = 1024U                      \
+	}
+
+bool wfb_fec_profile_valid(const wfb_fec_profile_t *profile);
@@ -0,0 +1,71 @@
+/**
+ * @file wfb_fec_ctl.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Адаптивное управление избыточностью FEC
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <wfb/wfb_fec.h>
+
+/* ground -> air loss feedback */
+#define WFB_FEC_FEEDBACK_PORT (62)
+
+/*
+ * Video link statistics of the ground receiver. Counters are cumulative, so
+ * a lost feedback packet does not lose information.
+ */
+typedef struct {
+	uint32_t seqno;
+	uint32_t received_block_cnt;
+	uint32_t damaged_block_cnt;
+	uint32_t lost_packet_cnt;
+	uint32_t received_packet_cnt;
+	uint32_t lost_per_block_cnt; /* peak lost packets per block in the last window */
+	uint32_t tx_restart_cnt;
+} __attribute__((packed)) wfb_fec_feedback_t;
+
+/* feedback as published on the air side */
+typedef struct {
+	uint64_t last_update;
+	wfb_fec_feedback_t feedback;
+} wfb_fec_feedback_status_t;
+
+typedef struct {
+	wfb_fec_profile_t profile; /* initial profile, data packets and length stay fixed */
+	size_t fec_min;
+	size_t fec_max;
+	uint32_t airtime_budget; /* max share of fec packets on air, percent */
+	uint64_t hold_time;	 /* clean link time before a fec packet is removed */
+	uint64_t timeout;	 /* no feedback for this time selects the max fec count */
+} wfb_fec_ctl_cfg_t;
+
+typedef struct {
+	wfb_fec_ctl_cfg_t cfg;
+	wfb_fec_profile_t profile;
+	size_t fec_limit;
+	wfb_fec_feedback_t last;
+	uint32_t last_sent; /* blocks the stream had sent at the last feedback */
+	uint32_t last_shed; /* parity shed per block given with the last feedback */
+	bool have_last;
+	uint64_t last_feedback;
+	uint64_t last_change;
+} wfb_fec_ctl_t;
+
+void wfb_fec_ctl_init(wfb_fec_ctl_t *ctl, const wfb_fec_ctl_cfg_t *cfg, uint64_t now);
+
+/*
+ * sent_blocks is the cumulative count of blocks the stream has sent, a feedback with no new
+ * blocks while the stream sends means nothing gets through. shed is the most parity packets
+ * the stream did not send of one block since the last feedback (see wfb_stream_shed()), the
+ * ground reports them as lost. Returns true if ctl->profile has changed
+ */
+bool wfb_fec_ctl_feedback(wfb_fec_ctl_t *ctl, const wfb_fec_feedback_t *fb, uint32_t sent_blocks,
+			  uint32_t shed, uint64_t now);
+
+/* returns true if ctl->profile has changed */
+bool wfb_fec_ctl_check(wfb_fec_ctl_t *ctl, uint64_t now);
@@ -0,0 +1,118 @@
+/**
+ * @file wfb_inject.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Общая отправка через адаптеры из очередей портов
+ */
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <svc/sharedmem.h>
+#include <svc/shm_ring.h>
+#include <wfb/wfb_status.h>
+#include <wfb/wfb_tx.h>
+
+#define WFB_INJECT_MAX_PORTS (8U)
+
+/* frames sent between two checks of the queues for wakeups at most */
+#define WFB_INJECT_BUDGET (64U)
+
+/* frames taken from the queues for one sendmmsg() per adapter */
+#define WFB_INJECT_BATCH (16U)
+
+#define WFB_INJECT_STATUS_PERIOD (100ULL * TIME_MS)
+
+#define WFB_INJECT_OUTQ "shm_inject_outq"
+
+/* how often the send queue is looked at again while it drains with nothing to send */
+#define WFB_INJECT_OUTQ_PERIOD_MS (2)
+
+/*
+ * The ports are given in order of priority, the first one goes first. A batch is taken
+ * by priority, and a bulk port (video) gives only a frame or two to each, so RC or
+ * telemetry never waits behind more than that
+ */
+typedef struct {
+	int port;
+	size_t slots; /* frames the queue holds */
+	size_t batch; /* frames of the port per batch at most, 0 for WFB_INJECT_BATCH */
+} wfb_inject_port_t;
+
+typedef struct {
+	uint32_t port;
+	uint32_t depth;	    /* frames waiting at the time of the report */
+	uint32_t depth_max; /* since the previous report */
+	uint32_t reserved;
+	uint64_t injected_cnt; /* sent by one adapter at least */
+	uint64_t dropped_cnt;  /* the queue was full */
+	uint64_t fail_cnt;     /* per adapter the send failed on, or no adapter for the frame */
+	uint64_t latency_avg;  /* ns from queueing to write(), since the previous report */
+	uint64_t latency_max;
+} wfb_inject_port_status_t;
+
+typedef struct {
+	uint64_t last_update;
+	uint32_t port_count;
+	uint32_t reserved;
+	wfb_inject_port_status_t port[WFB_INJECT_MAX_PORTS];
+	wifibroadcast_tx_status_t tx; /* all the ports together */
+} wfb_inject_status_t;
+
+/*
+ * Socket send queue of the adapters, written on every change. The senders count it in their
+ * backlog, the frames in the injector queue are only the part not taken yet
+ */
+typedef struct {
+	uint64_t last_update;
+	uint32_t bytes; /* the deepest SIOCOUTQ of the adapters */
+	uint32_t reserved;
+} wfb_inject_outq_t;
+
+typedef struct {
+	size_t port;
+	const wfb_tx_queued_t *queued;
+	size_t len; /* the frame after the queue header */
+	bool tried; /* an adapter was meant to send it */
+	bool sent;  /* at least one adapter did */
+} wfb_inject_frame_t;
+
+typedef struct {
+	int sock[NL_MAX_IFACES];
+	size_t count;
+	const wfb_inject_port_t *port;
+	size_t port_count;
+	shm_ring_t queue[WFB_INJECT_MAX_PORTS];
+	int epoll_fd;
+	bool pending; /* the budget was over with frames left */
+	wfb_inject_frame_t batch[WFB_INJECT_BATCH];
+	struct mmsghdr msgs[WFB_INJECT_BATCH];
+	struct iovec iov[WFB_INJECT_BATCH];
+	uint64_t latency_sum[WFB_INJECT_MAX_PORTS];
+	uint64_t latency_cnt[WFB_INJECT_MAX_PORTS];
+	wfb_inject_status_t status;
+	shm_t status_shm;
+	wfb_inject_outq_t outq;
+	shm_t outq_shm;
+} wfb_inject_t;
+
+/*
+ * Creates the queues of the ports, the status shm "shm_inject_status" and the send queue shm
+ * WFB_INJECT_OUTQ. Called before the services are started, the senders open their queue with
+ * the WFB_TX_BACKEND_QUEUE backend
+ */
+int wfb_inject_init(const wfb_inject_port_t ports[], size_t count);
+
+/*
+ * Opens a raw socket on every adapter and the queues of the ports
+ */
+int wfb_inject_open(wfb_inject_t *inj, const wfb_inject_port_t ports[], size_t count);
+
+/*
+ * Waits for the queues and sends their frames by priority, in batches of WFB_INJECT_BATCH
+ * with one sendmmsg() per adapter, WFB_INJECT_BUDGET at most. Returns the number of
+ * frames or -1
+ */
+int wfb_inject(wfb_inject_t *inj);
@@ -10,20 +10,134 @@
 
 #include <netlink/netlink.h>
 #include <pcap.h>
+#include <stdbool.h>
+#include <sys/socket.h>
 #include <svc/platform.h>
+#include <svc/shm_ring.h>
 
 #define MAX_MTU (1500)
 
+/* frame slot of the TPACKET_V3 ring and of the recvmmsg() batch */
+#define WFB_RX_FRAME_SIZE (4096U)
+
+/* frames taken by one recvmmsg() */
+#define WFB_RX_BATCH_DEFAULT (32U)
+
+/* wfb_rx_init() port taking the frames of all ports */
+#define WFB_RX_PORT_ANY (-1)
+
+/* ring of a port and an adapter the capture service fills, see wfb_capture.h */
+#define WFB_RX_SHARED_RING "wfb_rx_%i_%zu"
+
+typedef enum {
+	WFB_RX_BACKEND_PCAP = 0,   /* libpcap, pcap_next_ex() copy path */
+	WFB_RX_BACKEND_TPACKET_V3, /* AF_PACKET mmap ring */
+	WFB_RX_BACKEND_RAWSOCK,	   /* AF_PACKET socket, recvmmsg() batches */
+	WFB_RX_BACKEND_SHARED,	   /* frames of the port from the capture service */
+} wfb_rx_backend_t;
+
+typedef struct {
+	size_t block_size;	     /* multiple of the page size and WFB_RX_FRAME_SIZE */
+	size_t frame_count;	     /* frames of WFB_RX_FRAME_SIZE the ring holds */
+	unsigned int retire_timeout; /* ms, a block not filled up is handed over after this */
+} wfb_rx_ring_cfg_t;
+
+#define WFB_RX_RING_CFG_DEFAULT                                                                    \
+	{                                                                                          \
+		.block_size = 65536U, .frame_count = 512U, .retire_timeout = 1U                    \
+	}
+
+/* it_present words and antenna signal fields a radiotap layout is kept for */
+#define WFB_RX_RT_MAX_PRESENT (4U)
+#define WFB_RX_RT_MAX_SIGNALS (4U)
+
+/*
+ * Radiotap fields the receivers use, 0 or none if the frame has no such field
+ */
+typedef struct {
+	uint64_t tsft;
+	uint8_t flags; /* IEEE80211_RADIOTAP_F_* */
+	uint8_t rate;  /* 500 kbit/s units */
+	uint8_t mcs[3]; /* known, flags, index */
+	int8_t noise;
+	int8_t signal[WFB_RX_RT_MAX_SIGNALS]; /* dBm, one per antenna field in frame order */
+	size_t signals;
+} wfb_rx_radiotap_t;
+
+/*
+ * Offsets of those fields for one it_present layout, from the start of the radiotap header.
+ * A driver sends the same layout for nearly every frame, so it is parsed once
+ */
+typedef struct {
+	uint32_t present[WFB_RX_RT_MAX_PRESENT];
+	size_t present_words; /* 0 if there is no layout yet */
+	uint16_t len;	      /* it_len */
+	uint16_t tsft;	      /* 0 if absent, the header itself is at 0 */
+	uint16_t flags;
+	uint16_t rate;
+	uint16_t mcs;
+	uint16_t noise;
+	uint16_t signal[WFB_RX_RT_MAX_SIGNALS];
+	size_t signals;
+} wfb_rx_rt_layout_t;
+
+/*
+ * Captured frame kept past the next wfb_rx_next() call, see wfb_rx_hold()
+ */
+typedef struct {
+	const uint8_t *data;	/* start of the frame */
+	uint32_t *refs;		/* NULL if nothing is held */
+	uint32_t *block_status; /* ring block to give back to the kernel, NULL for the arena */
+} wfb_rx_frame_t;
+
+/*
+ * Refcounted frames of WFB_RX_FRAME_SIZE. recvmmsg() batches are received right into them,
+ * pcap frames are copied there when held
+ */
+typedef struct {
+	uint8_t *frames;
+	uint32_t *refs; /* a frame with no references is free */
+	size_t count;
+	size_t next; /* where to look for a free frame first */
+} wfb_rx_arena_t;
+
 typedef struct {
 	pcap_t *ppcap;
 	int selectable_fd;
 	size_t n80211HeaderLength;
+	wfb_rx_rt_layout_t rt_layout; /* of the last frame */
+	uint8_t *ring; /* TPACKET_V3 ring, NULL with pcap */
+	size_t ring_block_size;
+	size_t ring_block_count;
+	size_t ring_block;	   /* block being read */
+	uint8_t *ring_frame;	   /* next frame of the block, NULL if the block is not ours */
+	uint32_t ring_frames_left; /* frames left in the block */
+	uint32_t *ring_refs;	   /* per block, the reader and the frames held */
+	bool ring_stalled;	   /* the reader came round to a block still held */
+	wfb_rx_arena_t *arena;
+	struct iovec *batch_iov;    /* arena frames the batch is received into */
+	struct mmsghdr *batch_msgs; /* NULL if recvmmsg() is not used */
+	size_t batch_size;  /* frames the batch holds */
+	size_t batch_count; /* frames received by the last recvmmsg() */
+	size_t batch_next;  /* next frame to hand out */
+	shm_ring_t shared;  /* capture service ring, map is NULL if not used */
+	bool shared_front;  /* the frame returned last is still in the ring */
+	const uint8_t *last_data; /* frame last returned by wfb_rx_next() */
+	size_t last_len;
 } monitor_interface_t;
 
 typedef struct {
 	monitor_interface_t iface[NL_MAX_IFACES];
 	int8_t type[NL_MAX_IFACES];
 	size_t count;
+	wfb_rx_backend_t backend; /* capture backend, set before wfb_rx_init() */
+	wfb_rx_ring_cfg_t ring;	  /* ring parameters for WFB_RX_BACKEND_TPACKET_V3 */
+	size_t batch;		  /* frames per recvmmsg() for WFB_RX_BACKEND_RAWSOCK */
+	size_t hold_frames;	  /* frames held at the same time at most, see wfb_rx_hold() */
+	wfb_rx_arena_t arena;
+	int epoll_fd;		  /* all the adapters, see wfb_rx_fd() */
+	uint32_t ready;		  /* adapters reported ready and not drained yet */
+	size_t rr_next;		  /* adapter to be served first next time */
 } wfb_rx_t;
 
 typedef struct {
@@ -36,6 +150,62 @@ typedef struct {
 
 int wfb_rx_init(wfb_rx_t *wfb_rx, int port);
 
+/*
+ * Returns 1 and one packet if there is one. The ready adapters are served in turn and
+ * each is read until it has nothing left
+ */
 int wfb_rx_packet(wfb_rx_t *wfb_rx, wfb_rx_packet_t *rx_data);
 
+/*
+ * Readable when any adapter has data, to put the receiver into a service's own loop
+ */
+int wfb_rx_fd(const wfb_rx_t *wfb_rx);
+
+/*
+ * Waits up to timeout ms (epoll_wait() semantics) and marks the adapters having data
+ */
+int wfb_rx_wait(wfb_rx_t *wfb_rx, int timeout);
+
+/*
+ * The next marked adapter in round-robin order, false if none. An adapter stays marked
+ * until it is reported drained
+ */
+bool wfb_rx_ready(wfb_rx_t *wfb_rx, size_t *adapter);
+
+void wfb_rx_drained(wfb_rx_t *wfb_rx, size_t adapter);
+
 int wfb_rx_packet_interface(monitor_interface_t *interface, wfb_rx_packet_t *rx_data);
+
+/*
+ * Next captured frame (radiotap header first) of either backend. Returns 1 if there is one,
+ * the data stays valid until the next call for the interface
+ */
+int wfb_rx_next(monitor_interface_t *interface, const uint8_t **data, size_t *len);
+
+/*
+ * Reads the radiotap header of a captured frame. The layout of the last frame is reused
+ * while it_present and it_len stay the same, otherwise the header is walked and the layout
+ * refreshed. Returns -1 if the header is broken
+ */
+int wfb_rx_radiotap(monitor_interface_t *interface, const uint8_t *frame, size_t len,
+		    wfb_rx_radiotap_t *rt);
+
+/*
+ * Keeps the frame last returned by wfb_rx_next() for the adapter until wfb_rx_release().
+ * Ring and batch frames are referenced where they are, pcap ones are copied once. Returns
+ * the place of data (a pointer into that frame) in the held frame, or NULL if there is no
+ * room left
+ */
+const uint8_t *wfb_rx_hold(wfb_rx_t *wfb_rx, size_t adapter, const uint8_t *data,
+			   wfb_rx_frame_t *frame);
+
+void wfb_rx_release(wfb_rx_frame_t *frame);
+
+/*
+ * True if the ring reader of an adapter came round to a block with frames still held. The
+ * kernel stops there too and drops what comes until the holders let the block go, so they
+ * copy the frames held in the ring (see wfb_rx_frame_in_ring()) and release them
+ */
+bool wfb_rx_stalled(const wfb_rx_t *wfb_rx);
+
+bool wfb_rx_frame_in_ring(const wfb_rx_frame_t *frame);
@@ -8,7 +8,9 @@
 
 #pragma once
 
+#include <svc/platform.h>
 #include <svc/sharedmem.h>
+#include <wfb/wfb_fec.h>
 #include <wfb/wfb_rx.h>
 #include <wfb/wfb_status.h>
 
@@ -18,17 +20,62 @@ typedef struct {
 	size_t len; /* actual length of the packet stored in data */
 	bool valid;
 	bool crc_correct;
-	uint8_t *data;
+	uint8_t *data;	      /* in the held frame, or in buf */
+	wfb_rx_frame_t frame; /* captured frame data points into */
+	uint8_t *buf;	      /* own storage, for recovered packets and when nothing is held */
 } packet_buffer_t;
 
 typedef struct {
 	int block_num;
+	wfb_fec_profile_t fec; /* learned from the first packet of the block */
+	size_t emitted;	       /* data packets already passed through in order */
+	uint64_t last_ts;      /* time of the last packet stored, for the deadline flush */
+	bool flushed;	       /* passed on, the slot is kept until a new block takes it */
 	packet_buffer_t *packet_buffer_list;
 } block_buffer_t;
 
 typedef struct {
+	size_t block_buffers;	/* reorder window, blocks in progress at the same time */
+	uint64_t flush_timeout; /* a block idle for this time is flushed as it is */
+	/*
+	 * data packets are passed as soon as they and all the previous packets are
+	 * received, only missing ones wait for the block flush
+	 */
+	bool low_latency;
+	size_t rx_budget;	  /* packets taken per wfb_rx_stream() call at most */
+	wfb_rx_backend_t backend; /* capture backend of the adapters */
+	wfb_rx_ring_cfg_t ring;
+	size_t batch;
+} wfb_rx_stream_cfg_t;
+
+#define WFB_RX_STREAM_CFG_DEFAULT                                                                  \
+	{                                                                                          \
+		.block_buffers = 4U, .flush_timeout = 100ULL * TIME_MS, .low_latency = false,      \
+		.rx_budget = 32U, .backend = WFB_RX_BACKEND_PCAP,                                  \
+		.ring = WFB_RX_RING_CFG_DEFAULT, .batch = WFB_RX_BATCH_DEFAULT                     \
+	}
+
+/*
+ * Decoded data packet, given to the sink in stream order
+ */
+typedef struct {
+	const uint8_t *data; /* payload, valid during the sink call only */
+	size_t len;
+	int block_num;
+	size_t packet_num;
+	bool recovered; /* rebuilt by FEC */
+} wfb_rx_stream_data_t;
+
+typedef void (*wfb_rx_stream_sink_t)(void *arg, const wfb_rx_stream_data_t *packet);
+
+typedef struct {
+	wfb_rx_stream_cfg_t cfg;
+	wfb_rx_stream_sink_t sink;
+	void *sink_arg;
 	wfb_rx_t wfb_rx;
-	block_buffer_t *block_buffer_list;
+	block_buffer_t *block_buffer_list; /* ring of cfg.block_buffers, by block number */
+	int max_block_num;		   /* newest block seen */
+	int last_block_num;		   /* newest block flushed or given up */
 	uint64_t packetcounter_ts_prev[NL_MAX_IFACES];
 	uint64_t packetcounter_ts_now[NL_MAX_IFACES];
 	size_t packetcounter[NL_MAX_IFACES];
@@ -40,11 +87,16 @@ typedef struct {
 	wifibroadcast_rx_status_t rx_status;
 } wfb_rx_stream_t;
 
-typedef struct {
-	int bytes; // data length
-	uint8_t data[MAX_PACKET_LENGTH * 2U];
-} wfb_rx_stream_packet_t;
+int wfb_rx_stream_init(wfb_rx_stream_t *rx, int port, const wfb_rx_stream_cfg_t *cfg);
 
-int wfb_rx_stream_init(wfb_rx_stream_t *rx, int port);
+/*
+ * Where the decoded data packets go, packets are dropped without a sink
+ */
+void wfb_rx_stream_sink(wfb_rx_stream_t *rx, wfb_rx_stream_sink_t sink, void *arg);
 
-int wfb_rx_stream(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data);
+/*
+ * Takes the packets the adapters have, up to cfg.rx_budget, and passes the decoded ones to
+ * the sink. Returns the number of packets or -1, the fd of the receiver is
+ * wfb_rx_fd(&rx->wfb_rx)
+ */
+int wfb_rx_stream(wfb_rx_stream_t *rx);
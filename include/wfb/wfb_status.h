@@ -29,6 +29,9 @@ typedef struct {
 	uint32_t received_packet_cnt;
 	uint32_t lost_per_block_cnt;
 	uint32_t tx_restart_cnt;
+	uint32_t late_packet_cnt;      /* arrived after their block was flushed */
+	uint32_t duplicate_packet_cnt; /* already received through another adapter */
+	uint32_t timeout_flush_cnt;    /* blocks flushed on the deadline */
 	uint32_t kbitrate;
 	uint32_t current_air_datarate_kbit;
 	uint32_t wifi_adapter_cnt;
@@ -41,6 +44,9 @@ typedef struct {
 	uint32_t skipped_fec_cnt;
 	uint32_t injection_fail_cnt;
 	uint64_t injection_time_block;
+	uint32_t partial_send_cnt; /* sendmmsg() took only a part of the batch */
+	uint32_t send_again_cnt;   /* the adapter stayed busy for the send timeout (EAGAIN) */
+	uint32_t late_block_cnt;   /* blocks not sent at all, the link was too far behind */
 } wifibroadcast_tx_status_t;
 
 typedef struct {
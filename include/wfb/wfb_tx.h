@@ -8,20 +8,69 @@
 
 #pragma once
 
+#include <sys/uio.h>
+
 #include <netlink/netlink.h>
+#include <svc/shm_ring.h>
+
+/* queue of the frames of a port, see wfb_inject.h */
+#define WFB_TX_QUEUE "wfb_tx_%i"
+
+/* longest frame with the radiotap and IEEE headers a queue takes */
+#define WFB_TX_FRAME_SIZE (4096U)
+
+/* the queued frame goes to every adapter */
+#define WFB_TX_ADAPTER_ALL (UINT32_MAX)
+
+typedef enum {
+	WFB_TX_BACKEND_SOCKET = 0, /* own raw socket on every adapter */
+	WFB_TX_BACKEND_QUEUE,	   /* frames are queued to the injector service */
+	WFB_TX_BACKEND_TX_RING	   /* streams only: own PACKET_TX_RING, past the qdisc */
+} wfb_tx_backend_t;
+
+/*
+ * Header of a frame in the queue of a port
+ */
+typedef struct {
+	uint64_t ts; /* queueing time */
+	uint32_t adapter;
+	uint32_t reserved;
+} wfb_tx_queued_t;
+
+/* radiotap and IEEE headers of a wfb_tx_send() frame at most */
+#define WFB_TX_HEADER_SIZE (40U)
 
+/*
+ * Headers of an adapter laid out by wfb_tx_init(), for the adapter type and the port of the
+ * instance. The frame is sent as these, the sequence header, the payload and the padding
+ */
 typedef struct {
+	uint8_t hdr[WFB_TX_HEADER_SIZE];
+	size_t hdr_len;
+	size_t min_len; /* shorter payload is padded up to it */
+} wfb_tx_template_t;
+
+typedef struct {
+	wfb_tx_backend_t backend;
 	int sock[NL_MAX_IFACES];
 	int type[NL_MAX_IFACES];
 	size_t count;
 	size_t pcnt;
 	size_t stream_phdr_len;
+	shm_ring_t queue; /* WFB_TX_BACKEND_QUEUE only */
+	wfb_tx_template_t tmpl[NL_MAX_IFACES];
 } wfb_tx_t;
 
 int wfb_open_sock(const if_desc_t *iface);
 
 int wfb_tx_init(wfb_tx_t *wfb_tx, int port, bool use_cts);
 
+/*
+ * Queues a whole frame, gathered from the iovecs, to the injector for the adapter (or
+ * WFB_TX_ADAPTER_ALL). A full queue drops the frame, the injector reports it. Returns 0 or -1
+ */
+int wfb_tx_queue(wfb_tx_t *wfb_tx, uint32_t adapter, const struct iovec iov[], size_t iovcnt);
+
 void wfb_tx_send(wfb_tx_t *wfb_tx, uint32_t seqno, const uint8_t data[], uint16_t len);
 
 void wfb_tx_send_raw(wfb_tx_t *wfb_tx, const uint8_t data[], uint16_t len);
@@ -8,10 +8,17 @@
 
 #pragma once
 
+#include <svc/sharedmem.h>
+#include <wfb/wfb_fec.h>
+#include <wfb/wfb_status.h>
 #include <wfb/wfb_tx.h>
 
 #define MAX_PACKET_LENGTH (4192)
 
+/* PACKET_TX_RING of every adapter with WFB_TX_BACKEND_TX_RING */
+#define WFB_TX_RING_FRAME_SIZE (4096U)
+#define WFB_TX_RING_FRAMES (64U)
+
 typedef struct {
 	int valid;
 	int crc_correct;
@@ -20,20 +27,94 @@ typedef struct {
 } packet_buffer_t;
 
 typedef struct {
-	uint32_t seq_nr;
+	uint32_t block_num;
 	size_t curr_pb;
 	packet_buffer_t *pbl;
+	uint8_t *fec_blocks[WFB_FEC_MAX_PACKETS]; /* parity of the current block so far */
+	size_t fec_len;				   /* parity length, the longest data packet */
+	uint64_t inject_time;			   /* time spent in write() for the block */
+	uint64_t first_ts;			   /* first byte of the packet being filled */
+	bool late;				   /* the block is dropped whole */
 } input_buffer_t;
 
+/*
+ * Video pacing. The bucket fills at the air data rate given to the stream, a packet takes its
+ * bytes out. The backlog is the frames still waiting to go out: the injector queue and its
+ * socket send queue, or the socket send queue (SIOCOUTQ) of the stream. Both are checked
+ * before a packet is sent: parity is shed first, a block that starts too far behind is
+ * dropped whole
+ */
+typedef struct {
+	uint32_t rate_kbit;  /* 0 - no bucket, the backlog only */
+	uint32_t burst;	     /* bytes the bucket holds */
+	size_t backlog_fec;  /* parity is not sent above this backlog */
+	size_t backlog_late; /* a new block is dropped above this backlog */
+} wfb_tx_pacer_cfg_t;
+
+#define WFB_TX_PACER_CFG_DEFAULT                                                                   \
+	{                                                                                          \
+		.rate_kbit = 0U, .burst = 16384U, .backlog_fec = 32U, .backlog_late = 128U         \
+	}
+
+typedef struct {
+	wfb_tx_pacer_cfg_t cfg;
+	int64_t tokens; /* bytes, below zero when data went out over the rate */
+	uint64_t last;
+	uint32_t shed_max; /* most parity packets shed from one block, see wfb_stream_shed() */
+} wfb_tx_pacer_t;
+
+/*
+ * The frames have the radiotap and IEEE headers of the stream laid out once, a packet
+ * writes its packet header and payload only
+ */
+typedef struct {
+	uint8_t *map;
+	size_t next;   /* frame to fill */
+	size_t queued; /* frames not kicked with send() yet */
+} wfb_tx_ring_t;
+
 typedef struct {
 	wfb_tx_t wfb_tx;
+	wfb_tx_ring_t tx_ring[NL_MAX_IFACES];
 	size_t phdr_len;
 	input_buffer_t input_buffer;
+	wfb_fec_profile_t fec;	    /* profile of the block being filled */
+	wfb_fec_profile_t fec_next; /* applied at the next block boundary */
+	uint64_t coalesce;	    /* max time a packet is filled, 0 - send data at once */
+	wfb_tx_pacer_t pacer;
+	wifibroadcast_tx_status_t tx_status; /* updated at the end of every block */
+	shm_t outq_shm;			     /* injector send queue, WFB_TX_BACKEND_QUEUE only */
 	int port;
-	uint8_t buf[MAX_PACKET_LENGTH];
+	uint8_t buf[MAX_PACKET_LENGTH]; /* radiotap and IEEE headers of the stream */
 } wfb_stream_t;
 
-int wfb_stream_init(wfb_stream_t *wfb_stream, int port, int packet_type, bool useMCS, bool useSTBC,
-		    bool useLDPC);
+/*
+ * Raw socket on the adapter with the send timeout and buffer of the video stream
+ */
+int wfb_open_rawsock(const if_desc_t *iface);
+
+int wfb_stream_init(wfb_stream_t *wfb_stream, wfb_tx_backend_t backend, int port, int packet_type,
+		    const wfb_fec_profile_t *fec, bool useMCS, bool useSTBC, bool useLDPC);
+
+int wfb_stream_set_fec(wfb_stream_t *wfb_stream, const wfb_fec_profile_t *fec);
+
+/*
+ * Coalescing: data is collected into full packets, a packet is sent at most
+ * coalesce ns after its first byte. The stream owner calls wfb_stream_flush()
+ * when wfb_stream_deadline() (0 - nothing pending) has passed.
+ */
+int wfb_stream_set_coalesce(wfb_stream_t *wfb_stream, uint64_t coalesce);
+
+uint64_t wfb_stream_deadline(const wfb_stream_t *wfb_stream);
+
+int wfb_stream_set_pacer(wfb_stream_t *wfb_stream, const wfb_tx_pacer_cfg_t *cfg);
+
+/*
+ * Most parity packets the pacer shed from one block since the last call. The ground counts
+ * them as lost, the FEC controller must not answer them with more parity
+ */
+uint32_t wfb_stream_shed(wfb_stream_t *wfb_stream);
+
+void wfb_stream_flush(wfb_stream_t *wfb_stream);
 
 void wfb_tx_stream(wfb_stream_t *wfb_stream, uint8_t data[], uint16_t len);
@@ -7,9 +7,13 @@
  */
 
 #include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
 
 #include <log/log.h>
 #include <svc/sharedmem.h>
@@ -20,9 +24,14 @@
 
 #define SHM_START_IDX (0xFFFFFFFEU)
 
+/* the writer lapping the reader this many times in a row fails the read */
+#define SHM_READ_RETRIES (8U)
+
 typedef struct {
 	uint32_t index;
 	uint32_t size;
+	uint32_t seq; /* odd while the writer is copying into the slot */
+	uint32_t reserved;
 	uint64_t offset;
 } shm_slot_t;
 
@@ -30,7 +39,8 @@ typedef struct {
 	uint64_t magic;
 	uint32_t size;
 	uint32_t copies;
-	uint32_t index;
+	uint32_t index;	  /* the futex the readers wait on */
+	uint32_t waiters; /* readers in shm_map_wait(), no wakeup is sent without them */
 
 	shm_slot_t slot[SHM_COPIES];
 } shm_header_t;
@@ -80,11 +90,13 @@ shm_map_init(const char name[], size_t size)
 		header->size = size;
 		header->copies = SHM_COPIES;
 		header->index = SHM_START_IDX;
+		header->waiters = 0U;
 
 		uint32_t slot;
 		for (slot = 0U; slot < SHM_COPIES; slot++) {
 			header->slot[slot].index = SHM_START_IDX;
 			header->slot[slot].size = 0U;
+			header->slot[slot].seq = 0U;
 
 			header->slot[slot].offset = (align_size(size) * slot);
 		}
@@ -139,6 +151,7 @@ shm_map_open(const char name[], shm_t *shm)
 		shm->guard = SHM_GUARD;
 		shm->map = map;
 		shm->size = header.size;
+		shm->torn_cnt = 0U;
 
 		result = true;
 	} while (false);
@@ -160,7 +173,7 @@ shm_map_read(shm_t *shm, void **data)
 			log_err(NULL);
 		}
 
-		uint32_t index = hdr->index;
+		uint32_t index = __atomic_load_n(&hdr->index, __ATOMIC_ACQUIRE);
 
 		size_t slot = index % SHM_COPIES;
 
@@ -186,9 +199,12 @@ shm_map_write(shm_t *shm, void *data, size_t size)
 	} else {
 		shm_header_t *hdr = shm->map;
 
+		/* the only writer, nobody else changes the index and the counters */
 		uint32_t index = hdr->index;
 		index++;
 		size_t slot = index % SHM_COPIES;
+		shm_slot_t *s = &hdr->slot[slot];
+		uint32_t seq = s->seq;
 
 		union {
 			shm_header_t *h;
@@ -196,11 +212,135 @@ shm_map_write(shm_t *shm, void *data, size_t size)
 		} p;
 		p.h = &hdr[1];
 		void *dst;
-		dst = &p.u64[(hdr->slot[slot].offset) / sizeof(uint64_t *)];
+		dst = &p.u64[(s->offset) / sizeof(uint64_t *)];
+
+		/* a reader still copying the slot sees the odd counter and retries */
+		__atomic_store_n(&s->seq, seq + 1U, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
 
 		memcpy(dst, data, size);
 
-		hdr->index = index;
+		s->index = index;
+		s->size = (uint32_t)size;
+		__atomic_store_n(&s->seq, seq + 2U, __ATOMIC_RELEASE);
+
+		/* the index is stored before the waiters are counted, see shm_map_wait() */
+		__atomic_store_n(&hdr->index, index, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST) != 0U) {
+			syscall(SYS_futex, &hdr->index, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+		}
+	}
+
+	return result;
+}
+
+int32_t
+shm_map_fetch(shm_t *shm, void *data, size_t size, uint32_t *index)
+{
+	int32_t result = -1;
+
+	if (shm->guard != SHM_GUARD) {
+		log_err("shm guard error!");
+	} else {
+		const shm_header_t *hdr = shm->map;
+
+		if (size > shm->size) {
+			size = shm->size;
+		}
+
+		uint32_t tries;
+		for (tries = 0U; tries < SHM_READ_RETRIES; tries++) {
+			uint32_t idx = __atomic_load_n(&hdr->index, __ATOMIC_ACQUIRE);
+			const shm_slot_t *s = &hdr->slot[idx % SHM_COPIES];
+
+			uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+			if ((seq & 1U) == 0U) {
+				union {
+					const shm_header_t *h;
+					const uint64_t *u64;
+				} p;
+				p.h = &hdr[1];
+				memcpy(data, &p.u64[(s->offset) / sizeof(uint64_t *)], size);
+
+				/* the copy is done before the counter is checked again */
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+					if (index != NULL) {
+						*index = idx;
+					}
+					result = 0;
+					break;
+				}
+			}
+
+			shm->torn_cnt++;
+		}
+	}
+
+	return result;
+}
+
+int32_t
+shm_map_wait(shm_t *shm, uint32_t last_index, int timeout)
+{
+	int32_t result = 0;
+
+	if (shm->guard != SHM_GUARD) {
+		log_err("shm guard error!");
+		result = -1;
+	} else {
+		shm_header_t *hdr = shm->map;
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		if (timeout > 0) {
+			deadline.tv_sec += timeout / 1000;
+			deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+			if (deadline.tv_nsec >= 1000000000L) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+		}
+
+		/*
+		 * Counted before the index is checked: a write after the check either sees the
+		 * waiter and wakes it, or the futex sees the new index and does not sleep
+		 */
+		__atomic_fetch_add(&hdr->waiters, 1U, __ATOMIC_SEQ_CST);
+
+		while (__atomic_load_n(&hdr->index, __ATOMIC_SEQ_CST) == last_index) {
+			struct timespec ts;
+			struct timespec *tp = NULL;
+
+			if (timeout >= 0) {
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				ts.tv_sec = deadline.tv_sec - ts.tv_sec;
+				ts.tv_nsec = deadline.tv_nsec - ts.tv_nsec;
+				if (ts.tv_nsec < 0) {
+					ts.tv_sec--;
+					ts.tv_nsec += 1000000000L;
+				}
+				if (ts.tv_sec < 0) {
+					break;
+				}
+				tp = &ts;
+			}
+
+			if ((syscall(SYS_futex, &hdr->index, FUTEX_WAIT, last_index, tp, NULL, 0) <
+			     0) &&
+			    (errno != EAGAIN) && (errno != EINTR) && (errno != ETIMEDOUT)) {
+				log_err("futex() error: %i", errno);
+				result = -1;
+				break;
+			}
+		}
+
+		__atomic_fetch_sub(&hdr->waiters, 1U, __ATOMIC_SEQ_CST);
+
+		if ((result == 0) &&
+		    (__atomic_load_n(&hdr->index, __ATOMIC_ACQUIRE) != last_index)) {
+			result = 1;
+		}
 	}
 
 	return result;
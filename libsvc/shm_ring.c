@@ -0,0 +1,285 @@
+/**
+ * @file shm_ring.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Очередь в общей памяти, один писатель и один читатель
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <log/log.h>
+#include <svc/shm_ring.h>
+
+#define SHM_RING_MAGIC (0x53484D5F52494E47ULL)
+#define SHM_RING_GUARD (0x52494E4747554152ULL)
+
+#define SHM_RING_CACHELINE (64U)
+
+typedef struct {
+	uint64_t magic;
+	uint32_t slot_size;
+	uint32_t slots;
+	int32_t efd; /* inherited by the services under the same number */
+	uint32_t reserved;
+	uint64_t dropped; /* written by the writer only */
+
+	/* the writer and the reader each own a cache line */
+	uint64_t head __attribute__((aligned(SHM_RING_CACHELINE)));
+	uint64_t tail __attribute__((aligned(SHM_RING_CACHELINE)));
+} __attribute__((aligned(SHM_RING_CACHELINE))) shm_ring_header_t;
+
+typedef struct {
+	uint32_t size;
+	uint32_t reserved;
+} shm_ring_slot_t;
+
+static inline size_t
+slot_stride(size_t slot_size)
+{
+	return (sizeof(shm_ring_slot_t) + slot_size + (sizeof(uint64_t) - 1U)) &
+	       ~(sizeof(uint64_t) - 1U);
+}
+
+static inline size_t
+calc_ring_size(size_t slot_size, size_t slots)
+{
+	return sizeof(shm_ring_header_t) + (slot_stride(slot_size) * slots);
+}
+
+static inline shm_ring_slot_t *
+ring_slot(const shm_ring_t *ring, uint64_t index)
+{
+	uint8_t *base = (uint8_t *)ring->map + sizeof(shm_ring_header_t);
+
+	return (shm_ring_slot_t *)(base + (slot_stride(ring->slot_size) *
+					   (size_t)(index & (ring->slots - 1U))));
+}
+
+bool
+shm_ring_init(const char name[], size_t slot_size, size_t slots)
+{
+	bool result = false;
+
+	size_t count = 1U;
+	while (count < slots) {
+		count <<= 1U;
+	}
+
+	do {
+		char shm_name[256];
+		snprintf(shm_name, sizeof(shm_name), "/rhex_%s", name);
+		int fd = shm_open(shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+		if (fd < 0) {
+			log_err("shm_open() \"%s\" error", name);
+			break;
+		}
+
+		size_t map_size = calc_ring_size(slot_size, count);
+
+		if (ftruncate(fd, (off_t)map_size) == -1) {
+			log_err("cannot ftruncate()");
+			close(fd);
+			break;
+		}
+
+		void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			log_err("cannot mmap()");
+			break;
+		}
+
+		int efd = eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (efd < 0) {
+			log_err("eventfd() error: %i", errno);
+			munmap(map, map_size);
+			break;
+		}
+
+		shm_ring_header_t *header = map;
+		header->magic = SHM_RING_MAGIC;
+		header->slot_size = (uint32_t)slot_size;
+		header->slots = (uint32_t)count;
+		header->efd = efd;
+		header->dropped = 0ULL;
+		header->head = 0ULL;
+		header->tail = 0ULL;
+
+		munmap(map, map_size);
+
+		result = true;
+	} while (false);
+
+	return result;
+}
+
+bool
+shm_ring_open(const char name[], shm_ring_t *ring)
+{
+	bool result = false;
+
+	do {
+		char shm_name[256];
+		snprintf(shm_name, sizeof(shm_name), "/rhex_%s", name);
+		int fd = shm_open(shm_name, O_RDWR, S_IRUSR | S_IWUSR);
+		if (fd < 0) {
+			log_err("shm_open() \"%s\" error", name);
+			break;
+		}
+
+		void *map = mmap(NULL, sizeof(shm_ring_header_t), PROT_READ | PROT_WRITE,
+				 MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			log_err("cannot mmap()");
+			close(fd);
+			break;
+		}
+
+		shm_ring_header_t header;
+		memcpy(&header, map, sizeof(header));
+		munmap(map, sizeof(shm_ring_header_t));
+
+		if (header.magic != SHM_RING_MAGIC) {
+			close(fd);
+			log_err("invalid shm_magic");
+			break;
+		}
+
+		map = mmap(NULL, calc_ring_size(header.slot_size, header.slots),
+			   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			log_err("cannot mmap()");
+			break;
+		}
+
+		ring->guard = SHM_RING_GUARD;
+		ring->map = map;
+		ring->slot_size = header.slot_size;
+		ring->slots = header.slots;
+		ring->efd = header.efd;
+
+		result = true;
+	} while (false);
+
+	return result;
+}
+
+void *
+shm_ring_reserve(shm_ring_t *ring)
+{
+	void *result = NULL;
+
+	if (ring->guard != SHM_RING_GUARD) {
+		log_err("shm guard error!");
+	} else {
+		shm_ring_header_t *hdr = ring->map;
+
+		uint64_t head = hdr->head;
+		uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+
+		if ((head - tail) >= ring->slots) {
+			hdr->dropped++;
+		} else {
+			result = &ring_slot(ring, head)[1];
+		}
+	}
+
+	return result;
+}
+
+void
+shm_ring_commit(shm_ring_t *ring, size_t size)
+{
+	shm_ring_header_t *hdr = ring->map;
+
+	ring_slot(ring, hdr->head)->size = (uint32_t)size;
+	__atomic_store_n(&hdr->head, hdr->head + 1U, __ATOMIC_RELEASE);
+}
+
+void
+shm_ring_notify(shm_ring_t *ring)
+{
+	uint64_t one = 1U;
+
+	/* the counter can not overflow before the reader clears it, EAGAIN is fine anyway */
+	ssize_t r = write(ring->efd, &one, sizeof(one));
+	(void)r;
+}
+
+const void *
+shm_ring_front(shm_ring_t *ring, size_t *size)
+{
+	return shm_ring_peek(ring, 0U, size);
+}
+
+const void *
+shm_ring_peek(shm_ring_t *ring, size_t offset, size_t *size)
+{
+	const void *result = NULL;
+
+	if (ring->guard != SHM_RING_GUARD) {
+		log_err("shm guard error!");
+	} else {
+		shm_ring_header_t *hdr = ring->map;
+
+		uint64_t tail = hdr->tail;
+		uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+
+		if ((head - tail) > offset) {
+			shm_ring_slot_t *slot = ring_slot(ring, tail + offset);
+
+			*size = slot->size;
+			result = &slot[1];
+		}
+	}
+
+	return result;
+}
+
+void
+shm_ring_pop(shm_ring_t *ring)
+{
+	shm_ring_header_t *hdr = ring->map;
+
+	__atomic_store_n(&hdr->tail, hdr->tail + 1U, __ATOMIC_RELEASE);
+}
+
+void
+shm_ring_ack(shm_ring_t *ring)
+{
+	uint64_t value;
+
+	ssize_t r = read(ring->efd, &value, sizeof(value));
+	(void)r;
+}
+
+int
+shm_ring_fd(const shm_ring_t *ring)
+{
+	return ring->efd;
+}
+
+size_t
+shm_ring_count(const shm_ring_t *ring)
+{
+	const shm_ring_header_t *hdr = ring->map;
+
+	uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+	uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+
+	return (size_t)(head - tail);
+}
+
+uint64_t
+shm_ring_dropped(const shm_ring_t *ring)
+{
+	const shm_ring_header_t *hdr = ring->map;
+
+	return __atomic_load_n(&hdr->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,486 @@
+/**
+ * @file fec_bench.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Бенчмарк FEC: encode, reduce, invert_mat, resolve
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <private/fec.h>
+
+#define MAX_LIST (16U)
+#define MAX_BLOCKS (32U)
+
+typedef enum {
+	PATTERN_HEAD,
+	PATTERN_TAIL,
+	PATTERN_SPREAD,
+	PATTERN_RANDOM,
+	PATTERN_COUNT
+} erasure_pattern_t;
+
+static const char *pattern_names[PATTERN_COUNT] = {"head", "tail", "spread", "random"};
+
+typedef struct {
+	unsigned int val[MAX_LIST];
+	unsigned int count;
+} uint_list_t;
+
+typedef struct {
+	uint_list_t sizes;
+	uint_list_t data;
+	uint_list_t fec;
+	uint_list_t erasures;
+	bool patterns[PATTERN_COUNT];
+	const char *kernels[MAX_LIST];
+	unsigned int kernel_count;
+	unsigned int iterations;
+	double mhz;
+	bool csv;
+	bool no_cache;
+} bench_opts_t;
+
+static unsigned int rand_seed = 1U;
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -b LIST  block sizes in bytes (default 256,1024,1400)\n"
+		"  -k LIST  data packets per block (default 4,8,16)\n"
+		"  -n LIST  fec packets per block (default 2,4,8)\n"
+		"  -e LIST  erased data packets (default 1,2,4; capped by k and n)\n"
+		"  -p LIST  erasure patterns: head,tail,spread,random (default all)\n"
+		"  -K LIST  kernels: auto,scalar,ssse3,avx2,neon (default auto)\n"
+		"  -i NUM   iterations per case (default 2000)\n"
+		"  -f MHZ   CPU clock for cycles/byte when no cycle counter is available\n"
+		"  -C       disable the decode matrix cache\n"
+		"  -c       CSV output\n",
+		name);
+}
+
+static int
+parse_uint_list(const char *arg, uint_list_t *list)
+{
+	int result = 0;
+	char buf[256];
+	char *save = NULL;
+	char *tok;
+
+	list->count = 0U;
+	snprintf(buf, sizeof(buf), "%s", arg);
+
+	for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		unsigned long v = strtoul(tok, NULL, 10);
+
+		if ((v == 0UL) || (list->count >= MAX_LIST)) {
+			result = -1;
+			break;
+		}
+		list->val[list->count] = (unsigned int)v;
+		list->count++;
+	}
+
+	return result;
+}
+
+static int
+parse_patterns(const char *arg, bool patterns[PATTERN_COUNT])
+{
+	int result = 0;
+	char buf[256];
+	char *save = NULL;
+	char *tok;
+
+	memset(patterns, 0, sizeof(bool) * PATTERN_COUNT);
+	snprintf(buf, sizeof(buf), "%s", arg);
+
+	for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		unsigned int p;
+
+		for (p = 0U; p < PATTERN_COUNT; p++) {
+			if (strcmp(tok, pattern_names[p]) == 0) {
+				patterns[p] = true;
+				break;
+			}
+		}
+		if (p == PATTERN_COUNT) {
+			result = -1;
+			break;
+		}
+	}
+
+	return result;
+}
+
+static int
+parse_kernels(char *arg, bench_opts_t *opts)
+{
+	int result = 0;
+	char *save = NULL;
+	char *tok;
+
+	opts->kernel_count = 0U;
+
+	for (tok = strtok_r(arg, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		if (opts->kernel_count >= MAX_LIST) {
+			result = -1;
+			break;
+		}
+		opts->kernels[opts->kernel_count] = tok;
+		opts->kernel_count++;
+	}
+
+	return result;
+}
+
+/* erased data packet indices, sorted ascending as fec_decode() requires */
+static void
+make_erasures(erasure_pattern_t pattern, unsigned int k, unsigned int e, unsigned int *erased)
+{
+	unsigned int i;
+
+	switch (pattern) {
+	case PATTERN_HEAD:
+		for (i = 0U; i < e; i++) {
+			erased[i] = i;
+		}
+		break;
+
+	case PATTERN_TAIL:
+		for (i = 0U; i < e; i++) {
+			erased[i] = k - e + i;
+		}
+		break;
+
+	case PATTERN_SPREAD:
+		for (i = 0U; i < e; i++) {
+			erased[i] = (i * k) / e;
+		}
+		break;
+
+	case PATTERN_RANDOM: {
+		bool lost[MAX_BLOCKS] = {false};
+		unsigned int n = 0U;
+
+		while (n < e) {
+			unsigned int idx = (unsigned int)rand_r(&rand_seed) % k;
+			if (!lost[idx]) {
+				lost[idx] = true;
+				n++;
+			}
+		}
+
+		n = 0U;
+		for (i = 0U; i < k; i++) {
+			if (lost[i]) {
+				erased[n] = i;
+				n++;
+			}
+		}
+		break;
+	}
+
+	case PATTERN_COUNT:
+	default:
+		break;
+	}
+}
+
+static double
+cycles_per_byte(const fec_prof_counter_t *c, double mhz, double bytes)
+{
+	double cycles = (double)c->cycles;
+
+	if ((c->cycles == 0ULL) && (mhz > 0.0)) {
+		cycles = (double)c->ns * mhz / 1000.0;
+	}
+
+	return cycles / bytes;
+}
+
+/*
+ * Stages that are skipped for some blocks (invert on a cache hit) are averaged
+ * over all decoded blocks
+ */
+static void
+report(const bench_opts_t *opts, const char *op, const fec_prof_counter_t *c, uint64_t blocks,
+       unsigned int block_size, unsigned int k, unsigned int n, unsigned int e,
+       const char *pattern)
+{
+	double calls = (blocks > 0ULL) ? (double)blocks : 1.0;
+	/* throughput is counted over the data payload of a block */
+	double bytes = (double)block_size * (double)k * calls;
+	double seconds = (double)c->ns / 1e9;
+	double mbps = (seconds > 0.0) ? (bytes / seconds / 1e6) : 0.0;
+	double ns_per_block = (double)c->ns / calls;
+	double cpb = cycles_per_byte(c, opts->mhz, bytes);
+
+	if (opts->csv) {
+		printf("%s,%s,%u,%u,%u,%u,%s,%.2f,%.1f,%.3f\n", fec_kernel_name(), op, block_size,
+		       k, n, e, pattern, mbps, ns_per_block, cpb);
+	} else {
+		printf("%-7s %-8s %6u %3u %3u %3u %-7s %10.2f %12.1f %10.3f\n", fec_kernel_name(),
+		       op, block_size, k, n, e, pattern, mbps, ns_per_block, cpb);
+	}
+}
+
+static void
+bench_encode(const bench_opts_t *opts, unsigned char **data, unsigned char **fec,
+	     unsigned int block_size, unsigned int k, unsigned int n)
+{
+	fec_profile_t prof;
+	unsigned int i;
+
+	fec_profile_reset();
+	for (i = 0U; i < opts->iterations; i++) {
+		fec_encode(block_size, data, k, fec, n);
+	}
+	fec_profile_get(&prof);
+
+	report(opts, "encode", &prof.encode, prof.encode.calls, block_size, k, n, 0U, "-");
+}
+
+static int
+bench_decode(const bench_opts_t *opts, unsigned char **data, unsigned char **fec,
+	     unsigned char **work, unsigned char **fec_work, unsigned int block_size,
+	     unsigned int k, unsigned int n, unsigned int e, erasure_pattern_t pattern)
+{
+	int result = 0;
+	fec_profile_t prof;
+	unsigned int erased[MAX_BLOCKS];
+	unsigned int fec_nos[MAX_BLOCKS];
+	unsigned char *blocks[MAX_BLOCKS];
+	unsigned int i, j;
+
+	for (j = 0U; j < e; j++) {
+		fec_nos[j] = j;
+	}
+
+	fec_profile_reset();
+	for (i = 0U; i < opts->iterations; i++) {
+		make_erasures(pattern, k, e, erased);
+
+		/* fec_decode() works in place: restore parity, point lost packets to scratch */
+		for (j = 0U; j < k; j++) {
+			blocks[j] = data[j];
+		}
+		for (j = 0U; j < e; j++) {
+			memcpy(fec_work[j], fec[j], block_size);
+			memset(work[j], 0, block_size);
+			blocks[erased[j]] = work[j];
+		}
+
+		fec_decode(block_size, blocks, k, fec_work, fec_nos, erased, (unsigned short)e);
+
+		/*
+		 * Every iteration is checked: the first one builds the matrix, the others take
+		 * it from the cache. The check is not in the stage counters
+		 */
+		for (j = 0U; (j < e) && (result == 0); j++) {
+			if (memcmp(work[j], data[erased[j]], block_size) != 0) {
+				fprintf(stderr, "decode mismatch: k=%u n=%u e=%u %s, iteration %u\n",
+					k, n, e, pattern_names[pattern], i);
+				result = -1;
+			}
+		}
+	}
+	fec_profile_get(&prof);
+
+	report(opts, "reduce", &prof.reduce, prof.reduce.calls, block_size, k, n, e,
+	       pattern_names[pattern]);
+	report(opts, "invert", &prof.invert, prof.reduce.calls, block_size, k, n, e,
+	       pattern_names[pattern]);
+	report(opts, "resolve", &prof.resolve, prof.reduce.calls, block_size, k, n, e,
+	       pattern_names[pattern]);
+
+	return result;
+}
+
+static int
+bench_case(const bench_opts_t *opts, unsigned int block_size, unsigned int k, unsigned int n)
+{
+	int result = 0;
+	unsigned char *data[MAX_BLOCKS];
+	unsigned char *fec[MAX_BLOCKS];
+	unsigned char *work[MAX_BLOCKS];
+	unsigned char *fec_work[MAX_BLOCKS];
+	unsigned int i, ei;
+
+	for (i = 0U; i < MAX_BLOCKS; i++) {
+		data[i] = malloc(block_size);
+		fec[i] = malloc(block_size);
+		work[i] = malloc(block_size);
+		fec_work[i] = malloc(block_size);
+	}
+
+	do {
+		for (i = 0U; i < MAX_BLOCKS; i++) {
+			if ((data[i] == NULL) || (fec[i] == NULL) || (work[i] == NULL) ||
+			    (fec_work[i] == NULL)) {
+				fprintf(stderr, "out of memory\n");
+				result = -1;
+				break;
+			}
+		}
+		if (result != 0) {
+			break;
+		}
+
+		for (i = 0U; i < k; i++) {
+			unsigned int j;
+			for (j = 0U; j < block_size; j++) {
+				data[i][j] = (unsigned char)rand_r(&rand_seed);
+			}
+		}
+
+		bench_encode(opts, data, fec, block_size, k, n);
+
+		for (ei = 0U; ei < opts->erasures.count; ei++) {
+			unsigned int e = opts->erasures.val[ei];
+			unsigned int p;
+
+			if ((e > k) || (e > n)) {
+				continue;
+			}
+
+			for (p = 0U; p < PATTERN_COUNT; p++) {
+				if (!opts->patterns[p]) {
+					continue;
+				}
+				if (bench_decode(opts, data, fec, work, fec_work, block_size, k, n,
+						 e, (erasure_pattern_t)p) != 0) {
+					result = -1;
+				}
+			}
+		}
+	} while (false);
+
+	for (i = 0U; i < MAX_BLOCKS; i++) {
+		free(data[i]);
+		free(fec[i]);
+		free(work[i]);
+		free(fec_work[i]);
+	}
+
+	return result;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int result = EXIT_SUCCESS;
+	bench_opts_t opts;
+	static char default_kernels[] = "auto";
+	unsigned int ki, bi, di, fi;
+	int opt;
+
+	memset(&opts, 0, sizeof(opts));
+	parse_uint_list("256,1024,1400", &opts.sizes);
+	parse_uint_list("4,8,16", &opts.data);
+	parse_uint_list("2,4,8", &opts.fec);
+	parse_uint_list("1,2,4", &opts.erasures);
+	parse_patterns("head,tail,spread,random", opts.patterns);
+	parse_kernels(default_kernels, &opts);
+	opts.iterations = 2000U;
+
+	while ((opt = getopt(argc, argv, "b:k:n:e:p:K:i:f:Cch")) != -1) {
+		int r = 0;
+
+		switch (opt) {
+		case 'b':
+			r = parse_uint_list(optarg, &opts.sizes);
+			break;
+		case 'k':
+			r = parse_uint_list(optarg, &opts.data);
+			break;
+		case 'n':
+			r = parse_uint_list(optarg, &opts.fec);
+			break;
+		case 'e':
+			r = parse_uint_list(optarg, &opts.erasures);
+			break;
+		case 'p':
+			r = parse_patterns(optarg, opts.patterns);
+			break;
+		case 'K':
+			r = parse_kernels(optarg, &opts);
+			break;
+		case 'i':
+			opts.iterations = (unsigned int)strtoul(optarg, NULL, 10);
+			r = (opts.iterations == 0U) ? -1 : 0;
+			break;
+		case 'f':
+			opts.mhz = strtod(optarg, NULL);
+			break;
+		case 'C':
+			opts.no_cache = true;
+			break;
+		case 'c':
+			opts.csv = true;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (r != 0) {
+			fprintf(stderr, "invalid argument for -%c: %s\n", opt, optarg);
+			return EXIT_FAILURE;
+		}
+	}
+
+	fec_init();
+	fec_cache_enable(!opts.no_cache);
+
+	if (opts.csv) {
+		printf("kernel,op,block_size,k,n,erasures,pattern,mbps,ns_per_block,"
+		       "cycles_per_byte\n");
+	} else {
+		printf("%-7s %-8s %6s %3s %3s %3s %-7s %10s %12s %10s\n", "kernel", "op", "size",
+		       "k", "n", "e", "pattern", "MB/s", "ns/block", "cyc/byte");
+	}
+
+	for (ki = 0U; ki < opts.kernel_count; ki++) {
+		if (fec_set_kernel(opts.kernels[ki]) != 0) {
+			fprintf(stderr, "kernel '%s' is not available\n", opts.kernels[ki]);
+			result = EXIT_FAILURE;
+			continue;
+		}
+
+		for (bi = 0U; bi < opts.sizes.count; bi++) {
+			for (di = 0U; di < opts.data.count; di++) {
+				for (fi = 0U; fi < opts.fec.count; fi++) {
+					unsigned int k = opts.data.val[di];
+					unsigned int n = opts.fec.val[fi];
+
+					if ((k > MAX_BLOCKS) || (n > MAX_BLOCKS)) {
+						continue;
+					}
+
+					if (bench_case(&opts, opts.sizes.val[bi], k, n) != 0) {
+						result = EXIT_FAILURE;
+					}
+				}
+			}
+		}
+	}
+
+	fec_cache_stats_t cache;
+	fec_cache_stats(&cache);
+	fprintf(stderr,
+		"decode matrix cache: %llu hits, %llu misses, %llu single loss decodes\n",
+		(unsigned long long)cache.hits, (unsigned long long)cache.misses,
+		(unsigned long long)cache.single);
+
+	return result;
+}
@@ -1,4 +1,3 @@
-/*#define PROFILE*/
 /*
  * fec.c -- forward error correction based on Vandermonde matrices
  * 980624
@@ -43,6 +42,7 @@
 #define GF_BITS 8 /* code over GF(2**GF_BITS) - change to suit */
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -194,6 +194,13 @@ static gf gf_mul_table[(GF_SIZE + 1) * (GF_SIZE + 1)]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
 #define GF_MULC(dst, x) dst = __gf_mulc_[x]
 
+/*
+ * Split-nibble tables used by the vector kernels (see addmul() below):
+ * gf_mul_lo[c][x] = c * x, gf_mul_hi[c][x] = c * (x << 4), x < 16
+ */
+static gf gf_mul_lo[GF_SIZE + 1][16] __attribute__((aligned(32)));
+static gf gf_mul_hi[GF_SIZE + 1][16] __attribute__((aligned(32)));
+
 static void
 init_mul_table(void)
 {
@@ -204,6 +211,14 @@ init_mul_table(void)
 
 	for (j = 0; j < GF_SIZE + 1; j++)
 		gf_mul_table[j] = gf_mul_table[j << 8] = 0;
+
+	/* nibble tables for the vector kernels */
+	for (i = 0; i < GF_SIZE + 1; i++) {
+		for (j = 0; j < 16; j++) {
+			gf_mul_lo[i][j] = gf_mul_table[(i << 8) + j];
+			gf_mul_hi[i][j] = gf_mul_table[(i << 8) + (j << 4)];
+		}
+	}
 }
 
 /*
@@ -405,14 +420,6 @@ addmul1(gf *dst1, gf *src1, gf c, size_t sz)
 #define addmul1 slow_addmul1
 #endif
 
-static void
-addmul(gf *dst, gf *src, gf c, size_t sz)
-{
-	// fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
-	if (c != 0)
-		addmul1(dst, src, c, sz);
-}
-
 /*
  * mul() computes dst[] = c * src[]
  * This is used often, so better optimize it! Currently the loop is
@@ -535,12 +542,332 @@ mul1(gf *dst1, gf *src1, gf c, size_t sz)
 #define mul1 slow_mul1
 #endif
 
+/*
+ * Vectorized kernels.
+ *
+ * A product c * x in GF(2^8) is linear in x, so it can be split by nibbles:
+ *   c * x = c * (x & 0x0f) ^ c * (x & 0xf0)
+ * Both halves are looked up in 16-entry tables, which is exactly what the
+ * byte shuffle instructions (PSHUFB, VPSHUFB, NEON VTBL/TBL) do for a whole
+ * vector at once. The tables (gf_mul_lo/gf_mul_hi) are filled in init_mul_table().
+ *
+ * The scalar addmul1()/mul1() above stay the reference implementation and are
+ * also used for the tails shorter than one vector.
+ */
+typedef void (*gf_kernel_t)(gf *dst, gf *src, gf c, size_t sz);
+
+static inline void
+tail_addmul1(gf *dst, const gf *src, gf c, size_t sz)
+{
+	const gf *row = &gf_mul_table[c << 8];
+	size_t i;
+
+	for (i = 0; i < sz; i++)
+		dst[i] ^= row[src[i]];
+}
+
+static inline void
+tail_mul1(gf *dst, const gf *src, gf c, size_t sz)
+{
+	const gf *row = &gf_mul_table[c << 8];
+	size_t i;
+
+	for (i = 0; i < sz; i++)
+		dst[i] = row[src[i]];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FEC_HAVE_X86_KERNELS
+
+#include <immintrin.h>
+
+__attribute__((target("ssse3"))) static void
+ssse3_addmul1(gf *dst, gf *src, gf c, size_t sz)
+{
+	const __m128i lo = _mm_load_si128((const __m128i *)gf_mul_lo[c]);
+	const __m128i hi = _mm_load_si128((const __m128i *)gf_mul_hi[c]);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i;
+
+	for (i = 0; i + 16 <= sz; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+		__m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask));
+		__m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+		d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+		_mm_storeu_si128((__m128i *)&dst[i], d);
+	}
+
+	tail_addmul1(&dst[i], &src[i], c, sz - i);
+}
+
+__attribute__((target("ssse3"))) static void
+ssse3_mul1(gf *dst, gf *src, gf c, size_t sz)
+{
+	const __m128i lo = _mm_load_si128((const __m128i *)gf_mul_lo[c]);
+	const __m128i hi = _mm_load_si128((const __m128i *)gf_mul_hi[c]);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i;
+
+	for (i = 0; i + 16 <= sz; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(x, mask));
+		__m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(l, h));
+	}
+
+	tail_mul1(&dst[i], &src[i], c, sz - i);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_addmul1(gf *dst, gf *src, gf c, size_t sz)
+{
+	const __m256i lo =
+	    _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)gf_mul_lo[c]));
+	const __m256i hi =
+	    _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)gf_mul_hi[c]));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i;
+
+	for (i = 0; i + 32 <= sz; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+		__m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask));
+		__m256i h =
+		    _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+		d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+		_mm256_storeu_si256((__m256i *)&dst[i], d);
+	}
+
+	tail_addmul1(&dst[i], &src[i], c, sz - i);
+}
+
+__attribute__((target("avx2"))) static void
+avx2_mul1(gf *dst, gf *src, gf c, size_t sz)
+{
+	const __m256i lo =
+	    _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)gf_mul_lo[c]));
+	const __m256i hi =
+	    _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)gf_mul_hi[c]));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i;
+
+	for (i = 0; i + 32 <= sz; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask));
+		__m256i h =
+		    _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+		_mm256_storeu_si256((__m256i *)&dst[i], _mm256_xor_si256(l, h));
+	}
+
+	tail_mul1(&dst[i], &src[i], c, sz - i);
+}
+#endif /* x86 */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FEC_HAVE_NEON_KERNELS
+
+#include <arm_neon.h>
+
+static inline uint8x16_t
+neon_mul16(uint8x16_t x, const gf *lo_tbl, const gf *hi_tbl)
+{
+	const uint8x16_t mask = vdupq_n_u8(0x0f);
+	uint8x16_t xl = vandq_u8(x, mask);
+	uint8x16_t xh = vshrq_n_u8(x, 4);
+#if defined(__aarch64__)
+	uint8x16_t l = vqtbl1q_u8(vld1q_u8(lo_tbl), xl);
+	uint8x16_t h = vqtbl1q_u8(vld1q_u8(hi_tbl), xh);
+#else
+	/* armv7 has only 8-byte lookups: VTBL with a two register (16 entries) table */
+	uint8x8x2_t lo = {{vld1_u8(lo_tbl), vld1_u8(lo_tbl + 8)}};
+	uint8x8x2_t hi = {{vld1_u8(hi_tbl), vld1_u8(hi_tbl + 8)}};
+	uint8x16_t l = vcombine_u8(vtbl2_u8(lo, vget_low_u8(xl)), vtbl2_u8(lo, vget_high_u8(xl)));
+	uint8x16_t h = vcombine_u8(vtbl2_u8(hi, vget_low_u8(xh)), vtbl2_u8(hi, vget_high_u8(xh)));
+#endif
+	return veorq_u8(l, h);
+}
+
+static void
+neon_addmul1(gf *dst, gf *src, gf c, size_t sz)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= sz; i += 16) {
+		uint8x16_t p = neon_mul16(vld1q_u8(&src[i]), gf_mul_lo[c], gf_mul_hi[c]);
+		vst1q_u8(&dst[i], veorq_u8(vld1q_u8(&dst[i]), p));
+	}
+
+	tail_addmul1(&dst[i], &src[i], c, sz - i);
+}
+
+static void
+neon_mul1(gf *dst, gf *src, gf c, size_t sz)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= sz; i += 16) {
+		vst1q_u8(&dst[i], neon_mul16(vld1q_u8(&src[i]), gf_mul_lo[c], gf_mul_hi[c]));
+	}
+
+	tail_mul1(&dst[i], &src[i], c, sz - i);
+}
+
+#if !defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif /* NEON */
+
+/* kernels selected by select_kernels(), scalar until fec_init() */
+static gf_kernel_t addmul_kernel = addmul1;
+static gf_kernel_t mul_kernel = mul1;
+static const char *kernel_name = "scalar";
+
+/*
+ * Pick the fastest kernels supported by the CPU we are running on.
+ * Called once from fec_init().
+ */
+static void
+select_kernels(void)
+{
+	addmul_kernel = addmul1;
+	mul_kernel = mul1;
+	kernel_name = "scalar";
+
+#if defined(FEC_HAVE_X86_KERNELS)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		addmul_kernel = avx2_addmul1;
+		mul_kernel = avx2_mul1;
+		kernel_name = "avx2";
+	} else if (__builtin_cpu_supports("ssse3")) {
+		addmul_kernel = ssse3_addmul1;
+		mul_kernel = ssse3_mul1;
+		kernel_name = "ssse3";
+	}
+#elif defined(FEC_HAVE_NEON_KERNELS)
+#if !defined(__aarch64__)
+	if ((getauxval(AT_HWCAP) & HWCAP_NEON) == 0UL)
+		return;
+#endif
+	addmul_kernel = neon_addmul1;
+	mul_kernel = neon_mul1;
+	kernel_name = "neon";
+#endif
+}
+
+/*
+ * Optional per-stage counters, enabled by FEC_PROFILE (used by fec_bench).
+ * Cycles come from the TSC on x86 and stay zero elsewhere.
+ */
+#ifdef FEC_PROFILE
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static fec_profile_t profile;
+
+static inline void
+prof_now(uint64_t *ns, uint64_t *cycles)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	*ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#if defined(__x86_64__) || defined(__i386__)
+	*cycles = __rdtsc();
+#else
+	*cycles = 0ULL;
+#endif
+}
+
+static inline void
+prof_end(fec_prof_counter_t *c, uint64_t ns, uint64_t cycles)
+{
+	uint64_t end_ns, end_cycles;
+
+	prof_now(&end_ns, &end_cycles);
+	c->calls++;
+	c->ns += end_ns - ns;
+	c->cycles += end_cycles - cycles;
+}
+
+#define PROF_DECL uint64_t __prof_ns = 0ULL, __prof_cycles = 0ULL
+#define PROF_BEGIN(c) prof_now(&__prof_ns, &__prof_cycles)
+#define PROF_END(c) prof_end(&profile.c, __prof_ns, __prof_cycles)
+
+void
+fec_profile_get(fec_profile_t *p)
+{
+	*p = profile;
+}
+
+void
+fec_profile_reset(void)
+{
+	memset(&profile, 0, sizeof(profile));
+}
+#else
+#define PROF_DECL
+#define PROF_BEGIN(c)
+#define PROF_END(c)
+#endif /* FEC_PROFILE */
+
+const char *
+fec_kernel_name(void)
+{
+	return kernel_name;
+}
+
+int
+fec_set_kernel(const char name[])
+{
+	int result = 0;
+
+	if (strcmp(name, "auto") == 0) {
+		select_kernels();
+	} else if (strcmp(name, "scalar") == 0) {
+		addmul_kernel = addmul1;
+		mul_kernel = mul1;
+		kernel_name = "scalar";
+#if defined(FEC_HAVE_X86_KERNELS)
+	} else if ((strcmp(name, "ssse3") == 0) && __builtin_cpu_supports("ssse3")) {
+		addmul_kernel = ssse3_addmul1;
+		mul_kernel = ssse3_mul1;
+		kernel_name = "ssse3";
+	} else if ((strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+		addmul_kernel = avx2_addmul1;
+		mul_kernel = avx2_mul1;
+		kernel_name = "avx2";
+#elif defined(FEC_HAVE_NEON_KERNELS)
+	} else if (strcmp(name, "neon") == 0) {
+		select_kernels();
+		if (strcmp(kernel_name, "neon") != 0)
+			result = -1;
+#endif
+	} else {
+		result = -1;
+	}
+
+	return result;
+}
+
+static void
+addmul(gf *dst, gf *src, gf c, size_t sz)
+{
+	// fprintf(stderr, "Dst=%p Src=%p, gf=%02x sz=%d\n", dst, src, c, sz);
+	if (c != 0)
+		addmul_kernel(dst, src, c, sz);
+}
+
 static inline void
 mul(gf *dst, gf *src, gf c, size_t sz)
 {
 	/*fprintf(stderr, "%p = %02x * %p\n", dst, c, src);*/
 	if (c != 0)
-		mul1(dst, src, c, sz);
+		mul_kernel(dst, src, c, sz);
 	else
 		memset(dst, 0, sz);
 }
@@ -684,6 +1011,7 @@ fec_init(void)
 	init_mul_table();
 	TOCK(ticks[0]);
 	DDB(fprintf(stderr, "init_mul_table took %ldus\n", ticks[0]);)
+	select_kernels();
 	fec_initialized = 1;
 }
 
@@ -787,6 +1115,7 @@ fec_encode(unsigned int blockSize, unsigned char **data_blocks, unsigned int nrD
 {
 	unsigned int blockNo; /* loop for block counter */
 	unsigned int row, col;
+	PROF_DECL;
 
 	assert(fec_initialized);
 	assert(nrDataBlocks <= 128);
@@ -795,6 +1124,8 @@ fec_encode(unsigned int blockSize, unsigned char **data_blocks, unsigned int nrD
 	if (!nrDataBlocks)
 		return;
 
+	PROF_BEGIN(encode);
+
 	for (row = 0; row < nrFecBlocks; row++)
 		mul(fec_blocks[row], data_blocks[0], inverse[128 ^ row], blockSize);
 
@@ -803,6 +1134,33 @@ fec_encode(unsigned int blockSize, unsigned char **data_blocks, unsigned int nrD
 			addmul(fec_blocks[row], data_blocks[blockNo], inverse[row ^ col],
 			       blockSize);
 	}
+
+	PROF_END(encode);
+}
+
+/*
+ * Same as fec_encode(), one data block at a time: adds data block blockNo
+ * into all FEC blocks. Block 0 initializes them, so blocks must be added
+ * starting from 0.
+ */
+void
+fec_encode_add(unsigned int blockSize, unsigned char *data_block, unsigned int blockNo,
+	       unsigned char **fec_blocks, unsigned int nrFecBlocks)
+{
+	unsigned int row;
+	unsigned int col = 128 + blockNo;
+
+	assert(fec_initialized);
+	assert(blockNo < 128);
+	assert(nrFecBlocks <= 128);
+
+	if (blockNo == 0) {
+		for (row = 0; row < nrFecBlocks; row++)
+			mul(fec_blocks[row], data_block, inverse[row ^ col], blockSize);
+	} else {
+		for (row = 0; row < nrFecBlocks; row++)
+			addmul(fec_blocks[row], data_block, inverse[row ^ col], blockSize);
+	}
 }
 
 /**
@@ -837,19 +1195,59 @@ reduce(unsigned int blockSize, unsigned char **data_blocks, unsigned int nr_data
 	assert(nr_fec_blocks == erasedIdx);
 }
 
-#ifdef PROFILE
-static long long
-rdtsc(void)
+/*
+ * Inverted decode matrices depend only on the erasure pattern (erased data
+ * blocks and FEC blocks used), which tends to repeat. Keep the last ones.
+ */
+#define FEC_CACHE_SIZE (16U)
+#define FEC_CACHE_MAX_BLOCKS (32U)
+
+typedef struct {
+	uint32_t stamp; /* last use, 0 = empty */
+	unsigned short nr;
+	gf erased[FEC_CACHE_MAX_BLOCKS];
+	gf fec_nos[FEC_CACHE_MAX_BLOCKS];
+	gf matrix[FEC_CACHE_MAX_BLOCKS * FEC_CACHE_MAX_BLOCKS];
+} fec_cache_entry_t;
+
+static fec_cache_entry_t fec_cache[FEC_CACHE_SIZE];
+static uint32_t fec_cache_clock = 0U;
+static bool fec_cache_enabled = true;
+static fec_cache_stats_t fec_cache_counters;
+
+static bool
+cache_match(const fec_cache_entry_t *e, const unsigned int *fec_block_nos,
+	    const unsigned int *erased_blocks, unsigned short nr)
 {
-	unsigned long low, hi;
-	asm volatile("rdtsc" : "=d"(hi), "=a"(low));
-	return ((((long long)hi) << 32) | ((long long)low));
+	unsigned short i;
+
+	if ((e->stamp == 0U) || (e->nr != nr)) {
+		return false;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if ((e->erased[i] != erased_blocks[i]) || (e->fec_nos[i] != fec_block_nos[i])) {
+			return false;
+		}
+	}
+
+	return true;
 }
 
-long long reduceTime = 0;
-long long resolveTime = 0;
-long long invTime = 0;
-#endif
+void
+fec_cache_stats(fec_cache_stats_t *stats)
+{
+	*stats = fec_cache_counters;
+}
+
+void
+fec_cache_enable(bool enable)
+{
+	fec_cache_enabled = enable;
+	memset(fec_cache, 0, sizeof(fec_cache));
+	memset(&fec_cache_counters, 0, sizeof(fec_cache_counters));
+	fec_cache_clock = 0U;
+}
 
 /**
  * Resolves reduced system. Constructs "mini" encoding matrix, inverts
@@ -859,15 +1257,61 @@ static inline void
 resolve(size_t blockSize, unsigned char **data_blocks, unsigned char **fec_blocks,
 	unsigned int *fec_block_nos, unsigned int *erased_blocks, unsigned short nr_fec_blocks)
 {
-#ifdef PROFILE
-	long long begin;
-#endif
+	PROF_DECL;
+
+	if (nr_fec_blocks == 0) {
+		return;
+	}
+
+	if (nr_fec_blocks == 1) {
+		/*
+		 * Single loss: the 1x1 matrix is inverse[irow ^ icol], so its
+		 * inverse is irow ^ icol itself. No matrix to build or invert.
+		 */
+		fec_cache_counters.single++;
+		mul(data_blocks[erased_blocks[0]], fec_blocks[0],
+		    (gf)((128 + fec_block_nos[0]) ^ erased_blocks[0]), blockSize);
+		return;
+	}
+
 	/* construct matrix */
 	int row;
-	unsigned char matrix[nr_fec_blocks * nr_fec_blocks];
+	unsigned char scratch[nr_fec_blocks * nr_fec_blocks];
+	unsigned char *matrix = scratch;
+	fec_cache_entry_t *entry = NULL;
 	int ptr;
 	int r;
 
+	if (fec_cache_enabled && (nr_fec_blocks <= FEC_CACHE_MAX_BLOCKS)) {
+		unsigned int i;
+		fec_cache_entry_t *lru = &fec_cache[0];
+
+		fec_cache_clock++;
+
+		for (i = 0U; i < FEC_CACHE_SIZE; i++) {
+			if (cache_match(&fec_cache[i], fec_block_nos, erased_blocks,
+					nr_fec_blocks)) {
+				entry = &fec_cache[i];
+				break;
+			}
+			if (fec_cache[i].stamp < lru->stamp) {
+				lru = &fec_cache[i];
+			}
+		}
+
+		if (entry != NULL) {
+			fec_cache_counters.hits++;
+			entry->stamp = fec_cache_clock;
+			matrix = entry->matrix;
+			goto multiply;
+		}
+
+		fec_cache_counters.misses++;
+		entry = lru;
+		entry->stamp = 0U;
+		matrix = entry->matrix;
+	}
+
 	/* we pick the submatrix of code that keeps colums corresponding to
 	 * the erased data blocks, and rows corresponding to the present FEC
 	 * blocks. This is the matrix by which we would need to multiply the
@@ -882,13 +1326,9 @@ resolve(size_t blockSize, unsigned char **data_blocks, unsigned char **fec_block
 		}
 	}
 
-#ifdef PROFILE
-	begin = rdtsc();
-#endif
+	PROF_BEGIN(invert);
 	r = invert_mat(matrix, nr_fec_blocks);
-#ifdef PROFILE
-	invTime += rdtsc() - begin;
-#endif
+	PROF_END(invert);
 
 	if (r) {
 		int col;
@@ -904,6 +1344,18 @@ resolve(size_t blockSize, unsigned char **data_blocks, unsigned char **fec_block
 		assert(0);
 	}
 
+	if (entry != NULL) {
+		unsigned short i;
+
+		entry->stamp = fec_cache_clock;
+		entry->nr = nr_fec_blocks;
+		for (i = 0; i < nr_fec_blocks; i++) {
+			entry->erased[i] = (gf)erased_blocks[i];
+			entry->fec_nos[i] = (gf)fec_block_nos[i];
+		}
+	}
+
+multiply:
 	/* do the multiplication with the reduced code vector */
 	for (row = 0, ptr = 0; row < nr_fec_blocks; row++) {
 		int col;
@@ -921,35 +1373,17 @@ fec_decode(unsigned int blockSize,
 	   unsigned char **data_blocks, unsigned int nr_data_blocks, unsigned char **fec_blocks,
 	   unsigned int *fec_block_nos, unsigned int *erased_blocks, unsigned short nr_fec_blocks)
 {
-#ifdef PROFILE
-	long long begin;
-	long long end;
-#endif
+	PROF_DECL;
 
-#ifdef PROFILE
-	begin = rdtsc();
-#endif
+	PROF_BEGIN(reduce);
 	reduce(blockSize, data_blocks, nr_data_blocks, fec_blocks, fec_block_nos, erased_blocks,
 	       nr_fec_blocks);
-#ifdef PROFILE
-	end = rdtsc();
-	reduceTime += end - begin;
-	begin = end;
-#endif
-	resolve(blockSize, data_blocks, fec_blocks, fec_block_nos, erased_blocks, nr_fec_blocks);
-#ifdef PROFILE
-	end = rdtsc();
-	resolveTime += end - begin;
-#endif
-}
+	PROF_END(reduce);
 
-#ifdef PROFILE
-void
-printDetail(void)
-{
-	fprintf(stderr, "red=%9lld\nres=%9lld\ninv=%9lld\n", reduceTime, resolveTime, invTime);
+	PROF_BEGIN(resolve);
+	resolve(blockSize, data_blocks, fec_blocks, fec_block_nos, erased_blocks, nr_fec_blocks);
+	PROF_END(resolve);
 }
-#endif
 
 __attribute__((noreturn)) void
 fec_license(void)
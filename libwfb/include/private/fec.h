@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef struct fec_parms *fec_code_t;
 
 /*
@@ -21,6 +24,9 @@ void fec_init(void);
 void fec_encode(unsigned int blockSize, unsigned char **data_blocks, unsigned int nrDataBlocks,
 		unsigned char **fec_blocks, unsigned int nrFecBlocks);
 
+void fec_encode_add(unsigned int blockSize, unsigned char *data_block, unsigned int blockNo,
+		    unsigned char **fec_blocks, unsigned int nrFecBlocks);
+
 void fec_decode(unsigned int blockSize, unsigned char **data_blocks, unsigned int nr_data_blocks,
 		unsigned char **fec_blocks, unsigned int *fec_block_nos,
 		unsigned int *erased_blocks,
@@ -29,3 +35,43 @@ void fec_decode(unsigned int blockSize, unsigned char **data_blocks, unsigned in
 void fec_print(fec_code_t code, int width);
 
 void fec_license(void);
+
+/*
+ * GF(256) kernel selection: "auto", "scalar", "ssse3", "avx2", "neon".
+ * Returns -1 if the kernel is unknown or not supported by the CPU.
+ */
+int fec_set_kernel(const char name[]);
+
+const char *fec_kernel_name(void);
+
+/* decode matrix cache, see resolve() */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t single; /* single loss, no matrix needed */
+} fec_cache_stats_t;
+
+void fec_cache_stats(fec_cache_stats_t *stats);
+
+/* also clears the cache and its counters */
+void fec_cache_enable(bool enable);
+
+#ifdef FEC_PROFILE
+typedef struct {
+	uint64_t calls;
+	uint64_t ns;
+	uint64_t cycles;
+} fec_prof_counter_t;
+
+/* resolve includes invert */
+typedef struct {
+	fec_prof_counter_t encode;
+	fec_prof_counter_t reduce;
+	fec_prof_counter_t invert;
+	fec_prof_counter_t resolve;
+} fec_profile_t;
+
+void fec_profile_get(fec_profile_t *p);
+
+void fec_profile_reset(void);
+#endif /* FEC_PROFILE */
@@ -0,0 +1,34 @@
+/**
+ * @file wfb_proto.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Заголовки пакетов потока wifi broadcast
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * This sits at the payload of the wifi packet (outside of FEC)
+ *
+ * Every packet carries the FEC profile of its block, so the receiver does not
+ * need to know it in advance and follows profile changes between blocks.
+ */
+typedef struct {
+	uint32_t block_num;
+	uint8_t packet_num; /* data packets first, then fec packets */
+	uint8_t data_packets;
+	uint8_t fec_packets;
+	uint8_t flags; /* reserved, 0 */
+	uint16_t packet_length;
+} __attribute__((packed)) wifi_packet_header_t;
+
+/*
+ * This sits at the data payload (which is usually right after the wifi_packet_header_t)
+ * (inside of FEC)
+ */
+typedef struct {
+	uint32_t data_length;
+} __attribute__((packed)) payload_header_t;
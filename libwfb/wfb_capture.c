@@ -0,0 +1,185 @@
+/**
+ * @file wfb_capture.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Общий прием с адаптеров и разбор по портам
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <log/log.h>
+#include <wfb/wfb_capture.h>
+
+static void
+ring_name(char name[], size_t size, int port, size_t adapter)
+{
+	snprintf(name, size, WFB_RX_SHARED_RING, port, adapter);
+}
+
+int
+wfb_capture_init(const wfb_capture_port_t ports[], size_t count)
+{
+	int result = 0;
+
+	if_desc_t if_list[NL_MAX_IFACES];
+	char name[64];
+	size_t p;
+	size_t a;
+
+	do {
+		if (count > WFB_CAPTURE_MAX_PORTS) {
+			log_err("capture: %zu ports, %u at most", count, WFB_CAPTURE_MAX_PORTS);
+			result = -1;
+			break;
+		}
+
+		int if_count = nl_get_wlan_rt_list(if_list);
+		if (if_count < 0) {
+			log_err("cannot get wlan list");
+			result = -1;
+			break;
+		}
+
+		for (p = 0U; (p < count) && (result == 0); p++) {
+			for (a = 0U; a < (size_t)if_count; a++) {
+				ring_name(name, sizeof(name), ports[p].port, a);
+				if (!shm_ring_init(name, WFB_RX_FRAME_SIZE, ports[p].slots)) {
+					result = -1;
+					break;
+				}
+			}
+		}
+	} while (false);
+
+	return result;
+}
+
+int
+wfb_capture_open(wfb_capture_t *cap, const wfb_capture_port_t ports[], size_t count,
+		 wfb_rx_backend_t backend)
+{
+	int result = 0;
+
+	char name[64];
+	size_t p;
+	size_t a;
+
+	do {
+		cap->port = ports;
+		cap->port_count = count;
+		cap->foreign_cnt = 0U;
+
+		memset(&cap->wfb_rx, 0, sizeof(wfb_rx_t));
+		cap->wfb_rx.backend = backend;
+		cap->wfb_rx.ring = (wfb_rx_ring_cfg_t)WFB_RX_RING_CFG_DEFAULT;
+		cap->wfb_rx.batch = WFB_RX_BATCH_DEFAULT;
+
+		result = wfb_rx_init(&cap->wfb_rx, WFB_RX_PORT_ANY);
+		if (result != 0) {
+			break;
+		}
+
+		for (p = 0U; (p < count) && (result == 0); p++) {
+			cap->notify[p] = 0U;
+
+			for (a = 0U; a < cap->wfb_rx.count; a++) {
+				ring_name(name, sizeof(name), ports[p].port, a);
+				if (!shm_ring_open(name, &cap->ring[p][a])) {
+					result = -1;
+					break;
+				}
+			}
+		}
+	} while (false);
+
+	return result;
+}
+
+/*
+ * The port is the first byte of the MAC address, encoded as port * 2 + 1
+ */
+static int
+frame_port(const uint8_t *frame, size_t len)
+{
+	int result = -1;
+
+	if (len >= 4U) {
+		size_t rt_len = get_unaligned_le16(frame + 2U);
+
+		if ((len > (rt_len + 4U)) && ((frame[rt_len + 4U] & 1U) != 0U)) {
+			result = frame[rt_len + 4U] >> 1U;
+		}
+	}
+
+	return result;
+}
+
+int
+wfb_capture(wfb_capture_t *cap)
+{
+	int result = 0;
+
+	wfb_rx_t *wfb_rx = &cap->wfb_rx;
+	size_t frames = 0U;
+	size_t a;
+	size_t p;
+
+	if (wfb_rx->ready == 0U) {
+		/* 100ms timeout */
+		result = wfb_rx_wait(wfb_rx, 100);
+	}
+
+	while ((result >= 0) && (frames < WFB_CAPTURE_BUDGET) && wfb_rx_ready(wfb_rx, &a)) {
+		const uint8_t *frame;
+		size_t len;
+
+		if (wfb_rx_next(&wfb_rx->iface[a], &frame, &len) != 1) {
+			wfb_rx_drained(wfb_rx, a);
+			continue;
+		}
+
+		frames++;
+
+		int port = frame_port(frame, len);
+
+		for (p = 0U; p < cap->port_count; p++) {
+			if (cap->port[p].port == port) {
+				break;
+			}
+		}
+
+		if ((p == cap->port_count) || (len > WFB_RX_FRAME_SIZE)) {
+			cap->foreign_cnt++;
+			continue;
+		}
+
+		/* a full ring drops the frame, the ring counts it */
+		void *slot = shm_ring_reserve(&cap->ring[p][a]);
+		if (slot != NULL) {
+			memcpy(slot, frame, len);
+			shm_ring_commit(&cap->ring[p][a], len);
+			cap->notify[p] |= 1U << a;
+		}
+	}
+
+	/*
+	 * One wakeup per ring for the whole batch
+	 */
+	for (p = 0U; p < cap->port_count; p++) {
+		for (a = 0U; a < wfb_rx->count; a++) {
+			if ((cap->notify[p] & (1U << a)) != 0U) {
+				shm_ring_notify(&cap->ring[p][a]);
+			}
+		}
+
+		cap->notify[p] = 0U;
+	}
+
+	if (result >= 0) {
+		result = (int)frames;
+	}
+
+	return result;
+}
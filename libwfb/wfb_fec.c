@@ -0,0 +1,31 @@
+/**
+ * @file wfb_fec.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Параметры FEC потока wifi broadcast
+ */
+
+#include <private/wfb_proto.h>
+#include <wfb/wfb_fec.h>
+
+bool
+wfb_fec_profile_valid(const wfb_fec_profile_t *profile)
+{
+	bool result = true;
+
+	if ((profile->data_packets == 0U) || (profile->data_packets > WFB_FEC_MAX_PACKETS)) {
+		result = false;
+	}
+
+	if (profile->fec_packets > WFB_FEC_MAX_PACKETS) {
+		result = false;
+	}
+
+	if ((profile->packet_length <= sizeof(payload_header_t)) ||
+	    (profile->packet_length > WFB_FEC_MAX_PACKET_LENGTH)) {
+		result = false;
+	}
+
+	return result;
+}
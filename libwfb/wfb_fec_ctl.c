@@ -0,0 +1,160 @@
+/**
+ * @file wfb_fec_ctl.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Адаптивное управление избыточностью FEC
+ */
+
+#include <string.h>
+
+#include <log/log.h>
+#include <wfb/wfb_fec_ctl.h>
+
+/* spare fec packets over the worst block loss seen by the ground */
+#define FEC_CTL_MARGIN (1U)
+
+static void
+set_fec(wfb_fec_ctl_t *ctl, size_t fec_packets, uint64_t now, const char reason[])
+{
+	log_inf("FEC %zu/%zu -> %zu/%zu (%s)", ctl->profile.data_packets, ctl->profile.fec_packets,
+		ctl->profile.data_packets, fec_packets, reason);
+
+	ctl->profile.fec_packets = fec_packets;
+	ctl->last_change = now;
+}
+
+void
+wfb_fec_ctl_init(wfb_fec_ctl_t *ctl, const wfb_fec_ctl_cfg_t *cfg, uint64_t now)
+{
+	memset(ctl, 0, sizeof(wfb_fec_ctl_t));
+
+	ctl->cfg = *cfg;
+	ctl->profile = cfg->profile;
+
+	/*
+	 * Airtime budget: fec / (data + fec) <= budget
+	 */
+	ctl->fec_limit = cfg->fec_max;
+	if (cfg->airtime_budget < 100U) {
+		size_t budget_fec = (cfg->profile.data_packets * cfg->airtime_budget) /
+				    (100U - cfg->airtime_budget);
+		if (budget_fec < ctl->fec_limit) {
+			ctl->fec_limit = budget_fec;
+		}
+	}
+	if (ctl->fec_limit > WFB_FEC_MAX_PACKETS) {
+		ctl->fec_limit = WFB_FEC_MAX_PACKETS;
+	}
+	if (ctl->cfg.fec_min > ctl->fec_limit) {
+		ctl->cfg.fec_min = ctl->fec_limit;
+	}
+
+	if (ctl->profile.fec_packets > ctl->fec_limit) {
+		ctl->profile.fec_packets = ctl->fec_limit;
+	}
+	if (ctl->profile.fec_packets < ctl->cfg.fec_min) {
+		ctl->profile.fec_packets = ctl->cfg.fec_min;
+	}
+
+	ctl->last_feedback = now;
+	ctl->last_change = now;
+}
+
+bool
+wfb_fec_ctl_feedback(wfb_fec_ctl_t *ctl, const wfb_fec_feedback_t *fb, uint32_t sent_blocks,
+		     uint32_t shed, uint64_t now)
+{
+	bool result = false;
+	const size_t fec = ctl->profile.fec_packets;
+
+	do {
+		if (ctl->have_last && (fb->seqno == ctl->last.seqno)) {
+			/* duplicate */
+			break;
+		}
+
+		ctl->last_feedback = now;
+
+		const uint32_t sent = sent_blocks - ctl->last_sent;
+		ctl->last_sent = sent_blocks;
+
+		/* the ground window is longer than the feedback period, it may see the last one */
+		const uint32_t shed_max = (shed > ctl->last_shed) ? shed : ctl->last_shed;
+		ctl->last_shed = shed;
+
+		/*
+		 * First feedback, or the counters were reset on the ground: take a new base
+		 */
+		if (!ctl->have_last || (fb->tx_restart_cnt != ctl->last.tx_restart_cnt) ||
+		    (fb->received_block_cnt < ctl->last.received_block_cnt) ||
+		    (fb->damaged_block_cnt < ctl->last.damaged_block_cnt)) {
+			ctl->last = *fb;
+			ctl->have_last = true;
+			break;
+		}
+
+		const uint32_t blocks = fb->received_block_cnt - ctl->last.received_block_cnt;
+		const uint32_t damaged = fb->damaged_block_cnt - ctl->last.damaged_block_cnt;
+
+		ctl->last = *fb;
+
+		if (blocks == 0U) {
+			if ((sent > 0U) && (fec != ctl->fec_limit)) {
+				/* the ground is there but gets none of the blocks sent */
+				set_fec(ctl, ctl->fec_limit, now, "no blocks received");
+				result = true;
+			}
+			break;
+		}
+
+		/*
+		 * Parity the pacer shed is congestion, not loss: more parity would only add to it
+		 */
+		uint32_t lost = 0U;
+		if (fb->lost_per_block_cnt > shed_max) {
+			lost = fb->lost_per_block_cnt - shed_max;
+		}
+
+		size_t need = (size_t)lost + FEC_CTL_MARGIN;
+		if ((damaged > 0U) && (shed_max == 0U) && (need <= fec)) {
+			need = fec + 1U;
+		}
+		if (need > ctl->fec_limit) {
+			need = ctl->fec_limit;
+		}
+		if (need < ctl->cfg.fec_min) {
+			need = ctl->cfg.fec_min;
+		}
+
+		if (need > fec) {
+			/* losses grow: react at once */
+			set_fec(ctl, need, now, (damaged > 0U) ? "damaged blocks" : "losses");
+			result = true;
+		} else if ((need < fec) && ((now - ctl->last_change) >= ctl->cfg.hold_time)) {
+			/* clean link: give airtime back one packet at a time */
+			set_fec(ctl, fec - 1U, now, "clean link");
+			result = true;
+		} else if (need == fec) {
+			/* the current profile is right, restart the hold time */
+			ctl->last_change = now;
+		}
+	} while (false);
+
+	return result;
+}
+
+bool
+wfb_fec_ctl_check(wfb_fec_ctl_t *ctl, uint64_t now)
+{
+	bool result = false;
+
+	if (((now - ctl->last_feedback) >= ctl->cfg.timeout) &&
+	    (ctl->profile.fec_packets != ctl->fec_limit)) {
+		/* no idea what the ground sees: be safe */
+		set_fec(ctl, ctl->fec_limit, now, "no feedback");
+		result = true;
+	}
+
+	return result;
+}
@@ -0,0 +1,416 @@
+/**
+ * @file wfb_inject.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Общая отправка через адаптеры из очередей портов
+ */
+
+#include <linux/sockios.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+#include <log/log.h>
+#include <svc/svc.h>
+#include <wfb/wfb_inject.h>
+#include <wfb/wfb_tx_rawsock.h>
+
+int
+wfb_inject_init(const wfb_inject_port_t ports[], size_t count)
+{
+	int result = 0;
+
+	char name[64];
+	size_t p;
+
+	do {
+		if (count > WFB_INJECT_MAX_PORTS) {
+			log_err("inject: %zu ports, %u at most", count, WFB_INJECT_MAX_PORTS);
+			result = -1;
+			break;
+		}
+
+		for (p = 0U; p < count; p++) {
+			snprintf(name, sizeof(name), WFB_TX_QUEUE, ports[p].port);
+			if (!shm_ring_init(name, sizeof(wfb_tx_queued_t) + WFB_TX_FRAME_SIZE,
+					   ports[p].slots)) {
+				result = -1;
+				break;
+			}
+		}
+
+		if (result != 0) {
+			break;
+		}
+
+		if (!shm_map_init("shm_inject_status", sizeof(wfb_inject_status_t))) {
+			result = -1;
+			break;
+		}
+
+		if (!shm_map_init(WFB_INJECT_OUTQ, sizeof(wfb_inject_outq_t))) {
+			result = -1;
+			break;
+		}
+	} while (false);
+
+	return result;
+}
+
+int
+wfb_inject_open(wfb_inject_t *inj, const wfb_inject_port_t ports[], size_t count)
+{
+	int result = 0;
+
+	if_desc_t if_list[NL_MAX_IFACES];
+	char name[64];
+	size_t p;
+	size_t i;
+
+	do {
+		memset(inj, 0, sizeof(wfb_inject_t));
+		inj->port = ports;
+		inj->port_count = count;
+
+		int if_count = nl_get_wlan_rt_list(if_list);
+		if (if_count < 0) {
+			log_err("cannot get wlan list");
+			result = -1;
+			break;
+		}
+
+		for (i = 0U; (i < (size_t)if_count) && (i < NL_MAX_IFACES); i++) {
+			inj->sock[inj->count] = wfb_open_rawsock(&if_list[i]);
+			inj->count++;
+
+			/*
+			 * Wait a bit between configuring interfaces to reduce Atheros and Pi USB
+			 * flakiness
+			 */
+			usleep(20000);
+		}
+
+		inj->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (inj->epoll_fd < 0) {
+			log_err("epoll_create1() error: %i", errno);
+			result = -1;
+			break;
+		}
+
+		for (p = 0U; p < count; p++) {
+			snprintf(name, sizeof(name), WFB_TX_QUEUE, ports[p].port);
+			if (!shm_ring_open(name, &inj->queue[p])) {
+				result = -1;
+				break;
+			}
+
+			struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)p};
+			int fd = shm_ring_fd(&inj->queue[p]);
+			if (epoll_ctl(inj->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+				log_err("epoll_ctl() error: %i", errno);
+				result = -1;
+				break;
+			}
+
+			inj->status.port[p].port = (uint32_t)ports[p].port;
+		}
+
+		if (result != 0) {
+			break;
+		}
+
+		inj->status.port_count = (uint32_t)count;
+
+		if (!shm_map_open("shm_inject_status", &inj->status_shm)) {
+			result = -1;
+			break;
+		}
+
+		if (!shm_map_open(WFB_INJECT_OUTQ, &inj->outq_shm)) {
+			result = -1;
+			break;
+		}
+	} while (false);
+
+	return result;
+}
+
+/*
+ * Takes up to WFB_INJECT_BATCH frames from the queues, the highest port first, each port up
+ * to its batch limit. The frames stay in the queues until they are sent
+ */
+static size_t
+take_batch(wfb_inject_t *inj, size_t taken[])
+{
+	size_t count = 0U;
+	size_t p;
+
+	while (count < WFB_INJECT_BATCH) {
+		const void *queued = NULL;
+		size_t size = 0U;
+
+		for (p = 0U; p < inj->port_count; p++) {
+			if ((inj->port[p].batch != 0U) && (taken[p] >= inj->port[p].batch)) {
+				continue;
+			}
+
+			queued = shm_ring_peek(&inj->queue[p], taken[p], &size);
+			if (queued != NULL) {
+				break;
+			}
+		}
+
+		if (queued == NULL) {
+			break;
+		}
+
+		taken[p]++;
+
+		if (size < sizeof(wfb_tx_queued_t)) {
+			continue;
+		}
+
+		inj->batch[count].port = p;
+		inj->batch[count].queued = queued;
+		inj->batch[count].len = size - sizeof(wfb_tx_queued_t);
+		inj->batch[count].tried = false;
+		inj->batch[count].sent = false;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Sends the frames of the batch for the adapter with as few sendmmsg() as the socket
+ * allows. A short send is resumed, EAGAIN (the send timeout) drops the rest
+ */
+static void
+send_batch(wfb_inject_t *inj, size_t adapter, size_t count)
+{
+	wifibroadcast_tx_status_t *tx = &inj->status.tx;
+	size_t idx[WFB_INJECT_BATCH]; /* batch frames of the messages */
+	size_t n = 0U;
+	size_t sent = 0U;
+	size_t i;
+
+	for (i = 0U; i < count; i++) {
+		wfb_inject_frame_t *frame = &inj->batch[i];
+
+		if ((frame->queued->adapter != WFB_TX_ADAPTER_ALL) &&
+		    (frame->queued->adapter != adapter)) {
+			continue;
+		}
+
+		inj->iov[n].iov_base = (void *)&frame->queued[1];
+		inj->iov[n].iov_len = frame->len;
+
+		memset(&inj->msgs[n], 0, sizeof(struct mmsghdr));
+		inj->msgs[n].msg_hdr.msg_iov = &inj->iov[n];
+		inj->msgs[n].msg_hdr.msg_iovlen = 1U;
+		frame->tried = true;
+		idx[n] = i;
+		n++;
+	}
+
+	while (sent < n) {
+		int r = sendmmsg(inj->sock[adapter], &inj->msgs[sent], (unsigned int)(n - sent), 0);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				tx->send_again_cnt++;
+			} else {
+				log_warn("sendmmsg() failed: %i", errno);
+			}
+
+			break;
+		}
+
+		if ((sent + (size_t)r) < n) {
+			tx->partial_send_cnt++;
+		}
+
+		sent += (size_t)r;
+	}
+
+	for (i = 0U; i < sent; i++) {
+		inj->batch[idx[i]].sent = true;
+	}
+
+	for (i = sent; i < n; i++) {
+		inj->status.port[inj->batch[idx[i]].port].fail_cnt++;
+		tx->injection_fail_cnt++;
+	}
+}
+
+static void
+batch_done(wfb_inject_t *inj, size_t count, const size_t taken[])
+{
+	uint64_t now = svc_get_monotime();
+	size_t i;
+	size_t p;
+
+	for (i = 0U; i < count; i++) {
+		const wfb_inject_frame_t *frame = &inj->batch[i];
+		wfb_inject_port_status_t *st = &inj->status.port[frame->port];
+		uint64_t latency = now - frame->queued->ts;
+
+		if (!frame->sent) {
+			if (!frame->tried) {
+				/* the adapter it was queued for is not there */
+				st->fail_cnt++;
+				inj->status.tx.injection_fail_cnt++;
+			}
+			continue;
+		}
+
+		inj->latency_sum[frame->port] += latency;
+		inj->latency_cnt[frame->port]++;
+		if (latency > st->latency_max) {
+			st->latency_max = latency;
+		}
+
+		st->injected_cnt++;
+	}
+
+	for (p = 0U; p < inj->port_count; p++) {
+		for (i = 0U; i < taken[p]; i++) {
+			shm_ring_pop(&inj->queue[p]);
+		}
+	}
+}
+
+/*
+ * The senders see the frames handed to the sockets through this only
+ */
+static void
+update_outq(wfb_inject_t *inj)
+{
+	uint32_t bytes = 0U;
+	size_t a;
+
+	for (a = 0U; a < inj->count; a++) {
+		int outq = 0;
+
+		if ((ioctl(inj->sock[a], SIOCOUTQ, &outq) == 0) && ((uint32_t)outq > bytes)) {
+			bytes = (uint32_t)outq;
+		}
+	}
+
+	if (bytes != inj->outq.bytes) {
+		inj->outq.bytes = bytes;
+		inj->outq.last_update = svc_get_monotime();
+		shm_map_write(&inj->outq_shm, &inj->outq, sizeof(wfb_inject_outq_t));
+	}
+}
+
+static void
+update_status(wfb_inject_t *inj)
+{
+	uint64_t now = svc_get_monotime();
+	size_t p;
+
+	for (p = 0U; p < inj->port_count; p++) {
+		wfb_inject_port_status_t *st = &inj->status.port[p];
+		size_t depth = shm_ring_count(&inj->queue[p]);
+
+		st->depth = (uint32_t)depth;
+		if (st->depth > st->depth_max) {
+			st->depth_max = st->depth;
+		}
+	}
+
+	if ((now - inj->status.last_update) < WFB_INJECT_STATUS_PERIOD) {
+		return;
+	}
+
+	inj->status.last_update = now;
+	inj->status.tx.last_update = now;
+
+	for (p = 0U; p < inj->port_count; p++) {
+		wfb_inject_port_status_t *st = &inj->status.port[p];
+
+		st->dropped_cnt = shm_ring_dropped(&inj->queue[p]);
+		st->latency_avg = 0ULL;
+		if (inj->latency_cnt[p] > 0ULL) {
+			st->latency_avg = inj->latency_sum[p] / inj->latency_cnt[p];
+		}
+	}
+
+	shm_map_write(&inj->status_shm, &inj->status, sizeof(wfb_inject_status_t));
+
+	/* the window of the next report */
+	for (p = 0U; p < inj->port_count; p++) {
+		inj->status.port[p].depth_max = 0U;
+		inj->status.port[p].latency_max = 0ULL;
+		inj->latency_sum[p] = 0ULL;
+		inj->latency_cnt[p] = 0ULL;
+	}
+}
+
+int
+wfb_inject(wfb_inject_t *inj)
+{
+	int result = 0;
+
+	struct epoll_event events[WFB_INJECT_MAX_PORTS];
+	size_t frames = 0U;
+	size_t a;
+	int i;
+
+	/*
+	 * 100ms timeout, no wait while the last pass has left frames, a short one while the
+	 * sockets still drain
+	 */
+	int timeout = 100;
+	if (inj->pending) {
+		timeout = 0;
+	} else if (inj->outq.bytes > 0U) {
+		timeout = WFB_INJECT_OUTQ_PERIOD_MS;
+	}
+
+	int n = epoll_wait(inj->epoll_fd, events, WFB_INJECT_MAX_PORTS, timeout);
+	if ((n < 0) && (errno != EINTR)) {
+		log_err("epoll_wait() error: %i", errno);
+		result = -1;
+	}
+
+	/* the frames committed after this are woken up for again */
+	for (i = 0; i < n; i++) {
+		shm_ring_ack(&inj->queue[events[i].data.u32]);
+	}
+
+	while ((result == 0) && (frames < WFB_INJECT_BUDGET)) {
+		size_t taken[WFB_INJECT_MAX_PORTS] = {0U};
+
+		size_t count = take_batch(inj, taken);
+		if (count == 0U) {
+			/* nothing but broken slots, if anything */
+			batch_done(inj, 0U, taken);
+			break;
+		}
+
+		for (a = 0U; a < inj->count; a++) {
+			send_batch(inj, a, count);
+		}
+
+		batch_done(inj, count, taken);
+		frames += count;
+	}
+
+	inj->pending = (frames >= WFB_INJECT_BUDGET);
+
+	update_outq(inj);
+	update_status(inj);
+
+	if (result == 0) {
+		result = (int)frames;
+	}
+
+	return result;
+}
@@ -27,8 +27,19 @@
 #include <private/radiotap_rc.h>
 #include <wfb/wfb_rx.h>
 
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
 #include <pcap.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 
 static const struct radiotap_align_size align_size_000000_00[] = {
     [0] =
@@ -57,6 +68,252 @@ static const struct ieee80211_radiotap_vendor_namespaces vns = {
     .n_ns = sizeof(vns_array) / sizeof(vns_array[0]),
 };
 
+/*
+ * match (RTS BF) or (DATA, DATA SHORT, RTS (and port))
+ */
+static void
+filter_program(char szProgram[], int port)
+{
+	int port_encoded = (port * 2) + 1;
+
+	if (port == WFB_RX_PORT_ANY) {
+		sprintf(szProgram, "ether[0x00:2] == 0x0801 || ether[0x00:2] == 0x0802 || "
+				   "ether[0x00:4] == 0xb4010000");
+		return;
+	}
+
+	// if (param_rc_protocol != 99) { // only match on R/C packets if R/C enabled
+	/*sprintf(szProgram, "ether[0x00:4] == 0xb4bf0000 || ((ether[0x00:2] == 0x0801 ||
+ether[0x00:2] == 0x0802 || ether[0x00:4] == 0xb4010000) && ether[0x04:1] == 0x%.2x)",
+port_encoded);
+} else {*/
+	sprintf(szProgram,
+		"(ether[0x00:2] == 0x0801 || ether[0x00:2] == 0x0802 || "
+		"ether[0x00:4] == 0xb4010000) && ether[0x04:1] == 0x%.2x",
+		port_encoded);
+	//}
+}
+
+/*
+ * Takes a free frame of the arena with one reference, NULL if all are in use
+ */
+static uint8_t *
+arena_get(wfb_rx_arena_t *arena)
+{
+	uint8_t *result = NULL;
+	size_t i;
+
+	for (i = 0U; i < arena->count; i++) {
+		size_t f = (arena->next + i) % arena->count;
+
+		if (arena->refs[f] == 0U) {
+			arena->refs[f] = 1U;
+			arena->next = (f + 1U) % arena->count;
+			result = arena->frames + (f * WFB_RX_FRAME_SIZE);
+			break;
+		}
+	}
+
+	return result;
+}
+
+static uint32_t *
+arena_refs(wfb_rx_arena_t *arena, const uint8_t *frame)
+{
+	return &arena->refs[(size_t)(frame - arena->frames) / WFB_RX_FRAME_SIZE];
+}
+
+/*
+ * Drops a reference. A ring block nobody references any more goes back to the kernel
+ */
+static void
+frame_unref(uint32_t *refs, uint32_t *block_status)
+{
+	(*refs)--;
+
+	if ((*refs == 0U) && (block_status != NULL)) {
+		__atomic_store_n(block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * AF_PACKET socket of a monitor interface with the port filter attached, not bound yet
+ */
+static int
+open_packet_socket(const char name[], int port)
+{
+	struct bpf_program bpfprogram;
+	char szProgram[512];
+
+	/* protocol 0: nothing is queued until bind_packet_socket() sets ETH_P_ALL */
+	int fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd < 0) {
+		log_err("Unable to open %s: socket() error %i", name, errno);
+		exit(1);
+	}
+
+	/* the same check as the pcap link type */
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", name);
+	if ((ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) ||
+	    (ifr.ifr_hwaddr.sa_family != ARPHRD_IEEE80211_RADIOTAP)) {
+		log_err("ERROR: unknown encapsulation on %s! check if monitor mode is supported "
+			"and enabled",
+			name);
+		exit(1);
+	}
+
+	/*
+	 * The same filter as with pcap, compiled by libpcap and attached to the socket while
+	 * it is not bound yet, so it never gets any packets the filter would reject
+	 */
+	filter_program(szProgram, port);
+
+	pcap_t *dead = pcap_open_dead(DLT_IEEE802_11_RADIO, 3072);
+	if ((dead == NULL) || (pcap_compile(dead, &bpfprogram, szProgram, 1, 0) == -1)) {
+		log_err("%s", szProgram);
+		exit(1);
+	}
+
+	struct sock_fprog fprog = {
+	    .len = (unsigned short)bpfprogram.bf_len,
+	    .filter = (struct sock_filter *)bpfprogram.bf_insns,
+	};
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+		log_err("%s", szProgram);
+		log_err("setsockopt SO_ATTACH_FILTER: %i", errno);
+	}
+
+	pcap_freecode(&bpfprogram);
+	pcap_close(dead);
+
+	return fd;
+}
+
+static void
+bind_packet_socket(int fd, const char name[])
+{
+	struct sockaddr_ll sll;
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = (int)if_nametoindex(name);
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+		log_err("Unable to bind %s: %i", name, errno);
+		exit(1);
+	}
+}
+
+/*
+ * AF_PACKET socket with a TPACKET_V3 receive ring. Frames are read right from the ring
+ * memory, the kernel hands over whole blocks of them
+ */
+static void
+open_and_configure_ring(const char name[], monitor_interface_t *interface, int port,
+			const wfb_rx_ring_cfg_t *cfg)
+{
+	size_t page_size = (size_t)getpagesize();
+	if ((cfg->block_size == 0U) || ((cfg->block_size % page_size) != 0U) ||
+	    ((cfg->block_size % WFB_RX_FRAME_SIZE) != 0U)) {
+		log_err("ring block size %zu is not a multiple of the page and frame size",
+			cfg->block_size);
+		exit(1);
+	}
+
+	size_t frames_per_block = cfg->block_size / WFB_RX_FRAME_SIZE;
+	size_t block_count = (cfg->frame_count + frames_per_block - 1U) / frames_per_block;
+	if (block_count == 0U) {
+		block_count = 1U;
+	}
+
+	int fd = open_packet_socket(name, port);
+
+	int version = TPACKET_V3;
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		log_err("setsockopt PACKET_VERSION: %i", errno);
+		exit(1);
+	}
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = (unsigned int)cfg->block_size;
+	req.tp_block_nr = (unsigned int)block_count;
+	req.tp_frame_size = WFB_RX_FRAME_SIZE;
+	req.tp_frame_nr = (unsigned int)(block_count * frames_per_block);
+	req.tp_retire_blk_tov = cfg->retire_timeout;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		log_err("setsockopt PACKET_RX_RING: %i", errno);
+		exit(1);
+	}
+
+	interface->ring = mmap(NULL, cfg->block_size * block_count, PROT_READ | PROT_WRITE,
+			       MAP_SHARED | MAP_LOCKED, fd, 0);
+	if (interface->ring == MAP_FAILED) {
+		log_err("mmap() ring error: %i", errno);
+		exit(1);
+	}
+
+	interface->ring_refs = calloc(block_count, sizeof(uint32_t));
+	if (interface->ring_refs == NULL) {
+		log_err("malloc() failed");
+		exit(1);
+	}
+
+	bind_packet_socket(fd, name);
+
+	interface->ppcap = NULL;
+	interface->batch_msgs = NULL;
+	interface->shared.map = NULL;
+	interface->ring_block_size = cfg->block_size;
+	interface->ring_block_count = block_count;
+	interface->ring_block = 0U;
+	interface->ring_frame = NULL;
+	interface->ring_frames_left = 0U;
+	interface->selectable_fd = fd;
+}
+
+/*
+ * Plain AF_PACKET socket, frames are taken by batches of up to batch with recvmmsg()
+ * right into the frames of the arena
+ */
+static void
+open_and_configure_rawsock(const char name[], monitor_interface_t *interface, int port,
+			   size_t batch, wfb_rx_arena_t *arena)
+{
+	size_t i;
+
+	int fd = open_packet_socket(name, port);
+
+	interface->batch_iov = malloc(batch * sizeof(struct iovec));
+	interface->batch_msgs = malloc(batch * sizeof(struct mmsghdr));
+	if ((interface->batch_iov == NULL) || (interface->batch_msgs == NULL)) {
+		log_err("malloc() failed");
+		exit(1);
+	}
+
+	for (i = 0U; i < batch; i++) {
+		/* the frames are taken from the arena on the first recvmmsg() */
+		interface->batch_iov[i].iov_base = NULL;
+		interface->batch_iov[i].iov_len = WFB_RX_FRAME_SIZE;
+		memset(&interface->batch_msgs[i], 0, sizeof(struct mmsghdr));
+		interface->batch_msgs[i].msg_hdr.msg_iov = &interface->batch_iov[i];
+		interface->batch_msgs[i].msg_hdr.msg_iovlen = 1U;
+	}
+
+	bind_packet_socket(fd, name);
+
+	interface->ppcap = NULL;
+	interface->ring = NULL;
+	interface->shared.map = NULL;
+	interface->arena = arena;
+	interface->batch_size = batch;
+	interface->batch_count = 0U;
+	interface->batch_next = 0U;
+	interface->selectable_fd = fd;
+}
+
 static void
 open_and_configure_interface(const char name[], monitor_interface_t *interface, int port)
 {
@@ -64,8 +321,6 @@ open_and_configure_interface(const char name[], monitor_interface_t *interface,
 	char szProgram[512];
 	char szErrbuf[PCAP_ERRBUF_SIZE];
 
-	int port_encoded = (port * 2) + 1;
-
 	/* open the interface in pcap */
 	szErrbuf[0] = '\0';
 
@@ -81,18 +336,8 @@ open_and_configure_interface(const char name[], monitor_interface_t *interface,
 
 	int nLinkEncap = pcap_datalink(interface->ppcap);
 
-	/* match (RTS BF) or (DATA, DATA SHORT, RTS (and port)) */
 	if (nLinkEncap == DLT_IEEE802_11_RADIO) {
-		// if (param_rc_protocol != 99) { // only match on R/C packets if R/C enabled
-		/*sprintf(szProgram, "ether[0x00:4] == 0xb4bf0000 || ((ether[0x00:2] == 0x0801 ||
-	ether[0x00:2] == 0x0802 || ether[0x00:4] == 0xb4010000) && ether[0x04:1] == 0x%.2x)",
-	port_encoded);
-	} else {*/
-		sprintf(szProgram,
-			"(ether[0x00:2] == 0x0801 || ether[0x00:2] == 0x0802 || "
-			"ether[0x00:4] == 0xb4010000) && ether[0x04:1] == 0x%.2x",
-			port_encoded);
-		//}
+		filter_program(szProgram, port);
 	} else {
 		log_err("ERROR: unknown encapsulation on %s! check if monitor mode is supported "
 			"and enabled",
@@ -114,40 +359,495 @@ open_and_configure_interface(const char name[], monitor_interface_t *interface,
 		pcap_freecode(&bpfprogram);
 	}
 
+	interface->ring = NULL;
+	interface->batch_msgs = NULL;
+	interface->shared.map = NULL;
 	interface->selectable_fd = pcap_get_selectable_fd(interface->ppcap);
 }
 
+/*
+ * The frames of the port the capture service got from the adapter, nothing is opened here
+ */
+static void
+open_shared(monitor_interface_t *interface, int port, size_t adapter)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), WFB_RX_SHARED_RING, port, adapter);
+	if (!shm_ring_open(name, &interface->shared)) {
+		log_err("no capture ring for port %i, adapter %zu", port, adapter);
+		exit(1);
+	}
+
+	interface->ppcap = NULL;
+	interface->ring = NULL;
+	interface->batch_msgs = NULL;
+	interface->shared_front = false;
+	interface->selectable_fd = shm_ring_fd(&interface->shared);
+}
+
+/*
+ * Next frame of the TPACKET_V3 ring. The reader lets a block go on the call after its last
+ * frame, so the frame returned before stays valid until then. The block goes back to the
+ * kernel when the frames held from it are released as well
+ */
+static int
+ring_next(monitor_interface_t *interface, const uint8_t **data, size_t *len)
+{
+	int result = 0;
+
+	for (;;) {
+		uint8_t *block =
+		    interface->ring + (interface->ring_block * interface->ring_block_size);
+		struct tpacket_block_desc *bd = (struct tpacket_block_desc *)block;
+
+		if (interface->ring_frame == NULL) {
+			if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+			     TP_STATUS_USER) == 0U) {
+				/* nothing yet */
+				interface->ring_stalled = false;
+				break;
+			}
+
+			if (interface->ring_refs[interface->ring_block] != 0U) {
+				/*
+				 * The frames of the last round are still held, the kernel waits
+				 * for this block as well. See wfb_rx_stalled()
+				 */
+				interface->ring_stalled = true;
+				break;
+			}
+
+			interface->ring_stalled = false;
+
+			interface->ring_refs[interface->ring_block] = 1U;
+			interface->ring_frame = block + bd->hdr.bh1.offset_to_first_pkt;
+			interface->ring_frames_left = bd->hdr.bh1.num_pkts;
+		}
+
+		if (interface->ring_frames_left > 0U) {
+			struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)interface->ring_frame;
+
+			*data = interface->ring_frame + hdr->tp_mac;
+			*len = hdr->tp_snaplen;
+
+			interface->ring_frame += hdr->tp_next_offset;
+			interface->ring_frames_left--;
+			result = 1;
+			break;
+		}
+
+		/* the block is done */
+		frame_unref(&interface->ring_refs[interface->ring_block],
+			    &bd->hdr.bh1.block_status);
+		interface->ring_frame = NULL;
+		interface->ring_block = (interface->ring_block + 1U) % interface->ring_block_count;
+	}
+
+	return result;
+}
+
+/*
+ * Next frame of the batch, the batch is refilled with one recvmmsg() when it is used up.
+ * Frames held from the last batch are left to their holders, the batch takes free ones
+ */
+static int
+rawsock_next(monitor_interface_t *interface, const uint8_t **data, size_t *len)
+{
+	int result = 0;
+
+	for (;;) {
+		if (interface->batch_next < interface->batch_count) {
+			struct mmsghdr *msg = &interface->batch_msgs[interface->batch_next];
+
+			interface->batch_next++;
+
+			if ((msg->msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+				/* does not fit the frame, can not be one of ours */
+				continue;
+			}
+
+			*data = msg->msg_hdr.msg_iov->iov_base;
+			*len = msg->msg_len;
+			result = 1;
+			break;
+		}
+
+		interface->batch_count = 0U;
+		interface->batch_next = 0U;
+
+		size_t vlen;
+		for (vlen = 0U; vlen < interface->batch_size; vlen++) {
+			struct iovec *iov = &interface->batch_iov[vlen];
+
+			if (iov->iov_base != NULL) {
+				uint32_t *refs = arena_refs(interface->arena, iov->iov_base);
+
+				if (*refs == 1U) {
+					/* nobody else has it */
+					continue;
+				}
+
+				frame_unref(refs, NULL);
+			}
+
+			iov->iov_base = arena_get(interface->arena);
+			if (iov->iov_base == NULL) {
+				break;
+			}
+		}
+
+		if (vlen == 0U) {
+			log_warn("rx: all the frames are held");
+			break;
+		}
+
+		int n = recvmmsg(interface->selectable_fd, interface->batch_msgs,
+				 (unsigned int)vlen, MSG_DONTWAIT, NULL);
+		if (n <= 0) {
+			if ((n < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+				log_err("rx: recvmmsg() error %i", errno);
+				exit(2);
+			}
+			break;
+		}
+
+		interface->batch_count = (size_t)n;
+	}
+
+	return result;
+}
+
+/*
+ * Next frame of the capture ring. It is taken off the ring on the next call, the wakeup is
+ * cleared when the ring is empty
+ */
+static int
+shared_next(monitor_interface_t *interface, const uint8_t **data, size_t *len)
+{
+	int result = 0;
+
+	if (interface->shared_front) {
+		shm_ring_pop(&interface->shared);
+		interface->shared_front = false;
+	}
+
+	const void *frame = shm_ring_front(&interface->shared, len);
+	if (frame == NULL) {
+		shm_ring_ack(&interface->shared);
+		frame = shm_ring_front(&interface->shared, len);
+	}
+
+	if (frame != NULL) {
+		*data = frame;
+		interface->shared_front = true;
+		result = 1;
+	}
+
+	return result;
+}
+
 int
-wfb_rx_packet_interface(monitor_interface_t *interface, wfb_rx_packet_t *rx_data)
+wfb_rx_next(monitor_interface_t *interface, const uint8_t **data, size_t *len)
 {
 	int result = 0;
 
-	struct pcap_pkthdr *ppcapPacketHeader = NULL;
+	if (interface->ring != NULL) {
+		result = ring_next(interface, data, len);
+	} else if (interface->batch_msgs != NULL) {
+		result = rawsock_next(interface, data, len);
+	} else if (interface->shared.map != NULL) {
+		result = shared_next(interface, data, len);
+	} else {
+		struct pcap_pkthdr *ppcapPacketHeader = NULL;
+
+		result = pcap_next_ex(interface->ppcap, &ppcapPacketHeader, data);
+		if (result < 0) {
+			if (strcmp("The interface went down", pcap_geterr(interface->ppcap)) ==
+			    0) {
+				log_err("rx: The interface went down");
+				exit(9);
+			} else {
+				log_err("rx: %s", pcap_geterr(interface->ppcap));
+				exit(2);
+			}
+		}
+
+		if (result == 1) {
+			*len = ppcapPacketHeader->caplen;
+		}
+	}
+
+	if (result == 1) {
+		interface->last_data = *data;
+		interface->last_len = *len;
+	}
+
+	return result;
+}
+
+/*
+ * The kernel fills the ring blocks in order and stops at one still held. Frames are held in
+ * the ring only while the oldest held block is less than half the ring behind the reader,
+ * so it comes free before the kernel gets there. A slow stream retires blocks with a frame
+ * or two in each, its frames are copied then. A hold that outlives the round anyway is
+ * copied out by the holder, see wfb_rx_stalled()
+ */
+static bool
+ring_can_hold(const monitor_interface_t *interface)
+{
+	size_t count = interface->ring_block_count;
+	size_t i;
+
+	for (i = count - 1U; i > 0U; i--) {
+		if (interface->ring_refs[(interface->ring_block + count - i) % count] != 0U) {
+			break;
+		}
+	}
+
+	return i < (count / 2U);
+}
+
+const uint8_t *
+wfb_rx_hold(wfb_rx_t *wfb_rx, size_t adapter, const uint8_t *data, wfb_rx_frame_t *frame)
+{
+	monitor_interface_t *interface = &wfb_rx->iface[adapter];
+	const uint8_t *result = NULL;
+	size_t offset = (size_t)(data - interface->last_data);
+
+	do {
+		if ((interface->ring != NULL) && ring_can_hold(interface)) {
+			/* the frame stays in the ring, its block is not given back */
+			uint8_t *block =
+			    interface->ring + (interface->ring_block * interface->ring_block_size);
+
+			frame->data = interface->last_data;
+			frame->refs = &interface->ring_refs[interface->ring_block];
+			frame->block_status =
+			    &((struct tpacket_block_desc *)block)->hdr.bh1.block_status;
+		} else if (interface->batch_msgs != NULL) {
+			frame->data = interface->last_data;
+			frame->refs = arena_refs(interface->arena, interface->last_data);
+			frame->block_status = NULL;
+		} else {
+			/* pcap and the capture service reuse their buffers, a busy ring is spared */
+			uint8_t *copy = NULL;
+
+			if (interface->last_len <= WFB_RX_FRAME_SIZE) {
+				copy = arena_get(&wfb_rx->arena);
+			}
+
+			if (copy == NULL) {
+				break;
+			}
 
+			memcpy(copy, interface->last_data, interface->last_len);
+			frame->data = copy;
+			frame->refs = arena_refs(&wfb_rx->arena, copy);
+			frame->block_status = NULL;
+			result = copy + offset;
+			break;
+		}
+
+		(*frame->refs)++;
+		result = frame->data + offset;
+	} while (false);
+
+	return result;
+}
+
+bool
+wfb_rx_stalled(const wfb_rx_t *wfb_rx)
+{
+	bool result = false;
+	size_t i;
+
+	for (i = 0U; i < wfb_rx->count; i++) {
+		if (wfb_rx->iface[i].ring_stalled) {
+			result = true;
+			break;
+		}
+	}
+
+	return result;
+}
+
+bool
+wfb_rx_frame_in_ring(const wfb_rx_frame_t *frame)
+{
+	return (frame->refs != NULL) && (frame->block_status != NULL);
+}
+
+void
+wfb_rx_release(wfb_rx_frame_t *frame)
+{
+	if (frame->refs != NULL) {
+		frame_unref(frame->refs, frame->block_status);
+		frame->refs = NULL;
+	}
+}
+
+/*
+ * Walks the radiotap header and notes where the fields are. present_words stays 0 if the
+ * bitmap is too long to be kept
+ */
+static int
+radiotap_layout_parse(wfb_rx_rt_layout_t *layout, const uint8_t *frame, size_t len)
+{
 	struct ieee80211_radiotap_iterator rti;
-	// PENUMBRA_RADIOTAP_DATA prd;
-	uint8_t payloadBuffer[300];
-	uint8_t *pu8Payload = payloadBuffer;
+	const uint8_t *word = frame + 4U;
+
+	memset(layout, 0, sizeof(wfb_rx_rt_layout_t));
+
+	if (ieee80211_radiotap_iterator_init_rc(&rti, (struct ieee80211_radiotap_header *)frame,
+						len, &vns) < 0) {
+		return -1;
+	}
+
+	layout->len = (uint16_t)get_unaligned_le16(frame + 2U);
+
+	size_t words = 0U;
+	do {
+		if (words < WFB_RX_RT_MAX_PRESENT) {
+			layout->present[words] = get_unaligned_le32(word);
+		}
+		words++;
+		word += 4U;
+	} while ((get_unaligned_le32(word - 4U) & (1U << IEEE80211_RADIOTAP_EXT)) != 0U);
+
+	while (ieee80211_radiotap_iterator_next_rc(&rti) == 0) {
+		uint16_t offset = (uint16_t)(rti.this_arg - frame);
+
+		if (!rti.is_radiotap_ns) {
+			continue;
+		}
+
+		switch (rti.this_arg_index) {
+		case IEEE80211_RADIOTAP_TSFT:
+			layout->tsft = offset;
+			break;
+		case IEEE80211_RADIOTAP_FLAGS:
+			layout->flags = offset;
+			break;
+		case IEEE80211_RADIOTAP_RATE:
+			layout->rate = offset;
+			break;
+		case IEEE80211_RADIOTAP_MCS:
+			layout->mcs = offset;
+			break;
+		case IEEE80211_RADIOTAP_DBM_ANTNOISE:
+			layout->noise = offset;
+			break;
+		case IEEE80211_RADIOTAP_DBM_ANTSIGNAL:
+			if (layout->signals < WFB_RX_RT_MAX_SIGNALS) {
+				layout->signal[layout->signals] = offset;
+				layout->signals++;
+			}
+			break;
+		default:
+			/* do nothing */
+			break;
+		}
+	}
+
+	if (words <= WFB_RX_RT_MAX_PRESENT) {
+		layout->present_words = words;
+	}
+
+	return 0;
+}
+
+static bool
+radiotap_layout_match(const wfb_rx_rt_layout_t *layout, const uint8_t *frame, size_t len)
+{
+	bool result = false;
+	size_t i;
+
+	do {
+		if ((layout->present_words == 0U) || (len < layout->len) ||
+		    (len < (4U + (layout->present_words * 4U))) ||
+		    (get_unaligned_le16(frame + 2U) != layout->len)) {
+			break;
+		}
+
+		for (i = 0U; i < layout->present_words; i++) {
+			if (get_unaligned_le32(frame + 4U + (i * 4U)) != layout->present[i]) {
+				break;
+			}
+		}
+
+		/* a longer bitmap than the one kept has EXT set in the last word compared */
+		result = (i == layout->present_words);
+	} while (false);
+
+	return result;
+}
+
+static void
+radiotap_read(const wfb_rx_rt_layout_t *layout, const uint8_t *frame, wfb_rx_radiotap_t *rt)
+{
+	size_t i;
+
+	memset(rt, 0, sizeof(wfb_rx_radiotap_t));
+
+	if (layout->tsft != 0U) {
+		rt->tsft = le64toh(get_unaligned((const uint64_t *)(frame + layout->tsft)));
+	}
+	if (layout->flags != 0U) {
+		rt->flags = frame[layout->flags];
+	}
+	if (layout->rate != 0U) {
+		rt->rate = frame[layout->rate];
+	}
+	if (layout->mcs != 0U) {
+		memcpy(rt->mcs, frame + layout->mcs, sizeof(rt->mcs));
+	}
+	if (layout->noise != 0U) {
+		rt->noise = (int8_t)frame[layout->noise];
+	}
+
+	for (i = 0U; i < layout->signals; i++) {
+		rt->signal[i] = (int8_t)frame[layout->signal[i]];
+	}
+	rt->signals = layout->signals;
+}
+
+int
+wfb_rx_radiotap(monitor_interface_t *interface, const uint8_t *frame, size_t len,
+		wfb_rx_radiotap_t *rt)
+{
+	int result = 0;
+
+	if (radiotap_layout_match(&interface->rt_layout, frame, len)) {
+		radiotap_read(&interface->rt_layout, frame, rt);
+	} else {
+		result = radiotap_layout_parse(&interface->rt_layout, frame, len);
+		if (result == 0) {
+			radiotap_read(&interface->rt_layout, frame, rt);
+		}
+	}
+
+	return result;
+}
+
+int
+wfb_rx_packet_interface(monitor_interface_t *interface, wfb_rx_packet_t *rx_data)
+{
+	int result = 0;
+
+	wfb_rx_radiotap_t rt;
+	uint8_t *pu8Payload = NULL;
+	size_t packet_len = 0U;
 	ssize_t bytes;
-	int n;
 	int retval;
 	size_t u16HeaderLen;
 
 	// receive
-	retval = pcap_next_ex(interface->ppcap, &ppcapPacketHeader, (const u_char **)&pu8Payload);
-	if (retval < 0) {
-		if (strcmp("The interface went down", pcap_geterr(interface->ppcap)) == 0) {
-			log_err("rx: The interface went down");
-			exit(9);
-		} else {
-			log_err("rx: %s", pcap_geterr(interface->ppcap));
-			exit(2);
-		}
-	}
+	retval = wfb_rx_next(interface, (const uint8_t **)&pu8Payload, &packet_len);
 
 	if (retval != 1) {
 		// exit(1);
-		return 1;
+		return 0;
 	}
 
 	// fetch radiotap header length from radiotap header (seems to be 36 for Atheros and 18 for
@@ -180,62 +880,30 @@ wfb_rx_packet_interface(monitor_interface_t *interface, wfb_rx_packet_t *rx_data
 	}
 	pu8Payload -= u16HeaderLen;
 
-	// log_dbg("ppcapPacketHeader->len: %d", ppcapPacketHeader->len);
-	if (ppcapPacketHeader->len < (bpf_u_int32)(u16HeaderLen + interface->n80211HeaderLength)) {
+	// log_dbg("packet_len: %d", packet_len);
+	if (packet_len < (u16HeaderLen + interface->n80211HeaderLength)) {
 		exit(1);
 	}
 
-	bytes = (ssize_t)(ppcapPacketHeader->len - (u16HeaderLen + interface->n80211HeaderLength));
+	bytes = (ssize_t)(packet_len - (u16HeaderLen + interface->n80211HeaderLength));
 	// log_dbg(stderr, "bytes: %d", bytes);
 	if (bytes < 0) {
 		exit(1);
 	}
 
-	if (ieee80211_radiotap_iterator_init_rc(&rti,
-						(struct ieee80211_radiotap_header *)pu8Payload,
-						ppcapPacketHeader->len, &vns) < 0) {
+	if (wfb_rx_radiotap(interface, pu8Payload, packet_len, &rt) < 0) {
 		exit(1);
 	}
 
 	int dbm = -127;
 
-	while ((n = ieee80211_radiotap_iterator_next_rc(&rti)) == 0) {
-		switch (rti.this_arg_index) {
-		case IEEE80211_RADIOTAP_FLAGS:
-			// prd.m_nRadiotapFlags = *rti.this_arg;
-			break;
-		case IEEE80211_RADIOTAP_ANTENNA:
-			// ant[adapter_no] = (int8_t) (*rti.this_arg);
-			// log_dbg("Ant: %d", ant[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_DB_ANTSIGNAL:
-			// db[adapter_no] = (int8_t) (*rti.this_arg);
-			// log_dbg("DB: %d", db[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_DBM_ANTNOISE:
-			// dbm_noise[adapter_no] = (int8_t) (*rti.this_arg);
-			// log_dbg("DBM Noise: %d", dbm_noise[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_LOCK_QUALITY:
-			// quality[adapter_no] = (int16_t) (*rti.this_arg);
-			// log_dbg("Quality: %d", quality[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_TSFT:
-			// tsft[adapter_no] = (int64_t) (*rti.this_arg);
-			// log_dbg("TSFT: %d", tsft[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_DBM_ANTSIGNAL: {
-			int8_t signal_dbm = (int8_t)(*rti.this_arg);
-			if ((signal_dbm < 0) && (signal_dbm > -126)) {
-				if (signal_dbm > dbm) {
-					dbm = signal_dbm;
-				}
+	size_t s;
+	for (s = 0U; s < rt.signals; s++) {
+		int8_t signal_dbm = rt.signal[s];
+		if ((signal_dbm < 0) && (signal_dbm > -126)) {
+			if (signal_dbm > dbm) {
+				dbm = signal_dbm;
 			}
-		} break;
-
-		default:
-			/* do nothing */
-			break;
 		}
 	}
 
@@ -255,35 +923,83 @@ wfb_rx_packet_interface(monitor_interface_t *interface, wfb_rx_packet_t *rx_data
 }
 
 int
-wfb_rx_packet(wfb_rx_t *wfb_rx, wfb_rx_packet_t *rx_data)
+wfb_rx_fd(const wfb_rx_t *wfb_rx)
 {
-	int result = 0;
+	return wfb_rx->epoll_fd;
+}
+
+int
+wfb_rx_wait(wfb_rx_t *wfb_rx, int timeout)
+{
+	struct epoll_event events[NL_MAX_IFACES];
+	int result;
 
-	struct timeval to;
-	to.tv_sec = 0;
-	to.tv_usec = 1e5; // 100ms timeout
-	fd_set readset;
-	FD_ZERO(&readset);
-	int nfds = 0;
+	result = epoll_wait(wfb_rx->epoll_fd, events, NL_MAX_IFACES, timeout);
+	if (result < 0) {
+		if (errno == EINTR) {
+			result = 0;
+		} else {
+			log_err("epoll_wait() error: %i", errno);
+		}
+	}
 
+	int i;
+	for (i = 0; i < result; i++) {
+		wfb_rx->ready |= 1U << events[i].data.u32;
+	}
+
+	return result;
+}
+
+bool
+wfb_rx_ready(wfb_rx_t *wfb_rx, size_t *adapter)
+{
+	bool result = false;
 	size_t i;
-	for (i = 0; i < wfb_rx->count; i++) {
-		FD_SET(wfb_rx->iface[i].selectable_fd, &readset);
-		if (wfb_rx->iface[i].selectable_fd > nfds) {
-			nfds = wfb_rx->iface[i].selectable_fd;
+
+	for (i = 0U; i < wfb_rx->count; i++) {
+		size_t a = (wfb_rx->rr_next + i) % wfb_rx->count;
+
+		if ((wfb_rx->ready & (1U << a)) != 0U) {
+			/* the next call starts from the adapter after this one */
+			wfb_rx->rr_next = (a + 1U) % wfb_rx->count;
+			*adapter = a;
+			result = true;
+			break;
 		}
 	}
 
-	result = select(nfds + 1, &readset, NULL, NULL, &to);
+	return result;
+}
 
-	if (result > 0) {
-		for (i = 0; i < wfb_rx->count; i++) {
-			if (FD_ISSET(wfb_rx->iface[i].selectable_fd, &readset)) {
-				result = wfb_rx_packet_interface(&wfb_rx->iface[i], rx_data);
-				rx_data->adapter = i;
-				break;
-			}
+void
+wfb_rx_drained(wfb_rx_t *wfb_rx, size_t adapter)
+{
+	wfb_rx->ready &= ~(1U << adapter);
+}
+
+int
+wfb_rx_packet(wfb_rx_t *wfb_rx, wfb_rx_packet_t *rx_data)
+{
+	int result = 0;
+	size_t i;
+
+	if (wfb_rx->ready == 0U) {
+		/* 100ms timeout */
+		result = wfb_rx_wait(wfb_rx, 100);
+	}
+
+	/*
+	 * One packet per call, the ready adapters take turns until they have nothing left
+	 */
+	while ((result >= 0) && wfb_rx_ready(wfb_rx, &i)) {
+		result = wfb_rx_packet_interface(&wfb_rx->iface[i], rx_data);
+		if (result > 0) {
+			rx_data->adapter = i;
+			break;
 		}
+
+		wfb_rx_drained(wfb_rx, i);
 	}
 
 	return result;
@@ -309,6 +1025,39 @@ wfb_rx_init(wfb_rx_t *wfb_rx, int port)
 	FILE *procfile;
 
 	wfb_rx->count = 0U;
+	wfb_rx->ready = 0U;
+	wfb_rx->rr_next = 0U;
+
+	wfb_rx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (wfb_rx->epoll_fd < 0) {
+		log_err("epoll_create1() error: %i", errno);
+		return -1;
+	}
+
+	/*
+	 * Frames are held in the arena when they can not stay where they were captured. The
+	 * batches need frames of the arena besides the held ones
+	 */
+	if (wfb_rx->batch == 0U) {
+		wfb_rx->batch = 1U;
+	}
+
+	wfb_rx->arena.count = wfb_rx->hold_frames;
+	if (wfb_rx->backend == WFB_RX_BACKEND_RAWSOCK) {
+		wfb_rx->arena.count += num_if * wfb_rx->batch;
+	}
+
+	wfb_rx->arena.next = 0U;
+	wfb_rx->arena.frames = NULL;
+	wfb_rx->arena.refs = NULL;
+	if (wfb_rx->arena.count > 0U) {
+		wfb_rx->arena.frames = malloc(wfb_rx->arena.count * WFB_RX_FRAME_SIZE);
+		wfb_rx->arena.refs = calloc(wfb_rx->arena.count, sizeof(uint32_t));
+		if ((wfb_rx->arena.frames == NULL) || (wfb_rx->arena.refs == NULL)) {
+			log_err("malloc() failed");
+			return -1;
+		}
+	}
 
 	size_t i;
 	for (i = 0U; i < num_if; i++) {
@@ -342,8 +1091,37 @@ wfb_rx_init(wfb_rx_t *wfb_rx, int port)
 			wfb_rx->type[wfb_rx->count] = (int8_t)(1);
 		}
 
-		open_and_configure_interface(if_list[i].ifname, &wfb_rx->iface[wfb_rx->count],
-					     port);
+		wfb_rx->iface[wfb_rx->count].ring_stalled = false;
+
+		switch (wfb_rx->backend) {
+		case WFB_RX_BACKEND_TPACKET_V3:
+			open_and_configure_ring(if_list[i].ifname, &wfb_rx->iface[wfb_rx->count],
+						port, &wfb_rx->ring);
+			break;
+		case WFB_RX_BACKEND_RAWSOCK:
+			open_and_configure_rawsock(if_list[i].ifname,
+						   &wfb_rx->iface[wfb_rx->count], port,
+						   wfb_rx->batch, &wfb_rx->arena);
+			break;
+		case WFB_RX_BACKEND_SHARED:
+			open_shared(&wfb_rx->iface[wfb_rx->count], port, wfb_rx->count);
+			break;
+		case WFB_RX_BACKEND_PCAP:
+		default:
+			open_and_configure_interface(if_list[i].ifname,
+						     &wfb_rx->iface[wfb_rx->count], port);
+			break;
+		}
+
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u32 = (uint32_t)wfb_rx->count;
+		if (epoll_ctl(wfb_rx->epoll_fd, EPOLL_CTL_ADD,
+			      wfb_rx->iface[wfb_rx->count].selectable_fd, &ev) < 0) {
+			log_err("epoll_ctl() error: %i", errno);
+			result = -1;
+			break;
+		}
 		wfb_rx->count++;
 
 		usleep(10000); // wait a bit between configuring interfaces to reduce Atheros and Pi
@@ -26,41 +26,17 @@
 
 #include <log/log.h>
 #include <private/fec.h>
+#include <private/wfb_proto.h>
 #include <svc/svc.h>
 #include <wfb/wfb_rx_rawsock.h>
 
-#define MAX_DATA_OR_FEC_PACKETS_PER_BLOCK 32
-
-/*
- * This sits at the payload of the wifi packet (outside of FEC)
- *
- */
-typedef struct {
-	uint32_t sequence_number;
-} __attribute__((packed)) wifi_packet_header_t;
-
-/*
- * This sits at the data payload (which is usually right after the wifi_packet_header_t) (inside of
- * FEC)
- *
- */
-typedef struct {
-	uint32_t data_length;
-} __attribute__((packed)) payload_header_t;
-
 struct payload_data_t {
 	const uint8_t *data;
 	size_t size;
 	bool crc_ok;
+	size_t adapter; /* the frame came from, to hold it */
 };
 
-static const size_t param_data_packets_per_block = 8U;
-static const size_t param_fec_packets_per_block = 4U;
-static const size_t param_block_buffers = 1U;
-static const size_t param_packet_length = 1024U;
-
-static int max_block_num = -1;
-
 static uint64_t prev_time = 0ULL;
 static uint64_t now = 0ULL;
 
@@ -85,13 +61,47 @@ init_packet_buffer(packet_buffer_t *p)
 	p->crc_correct = false;
 	p->len = 0U;
 	p->data = NULL;
+	p->frame.refs = NULL;
 }
 
 static void
 alloc_packet_buffer(packet_buffer_t *p, size_t len)
 {
 	p->len = 0U;
-	p->data = (uint8_t *)malloc(len);
+	p->buf = (uint8_t *)malloc(len);
+	p->data = p->buf;
+}
+
+/*
+ * Lets the captured frame go, the packet is not needed any more
+ */
+static void
+release_packet_buffer(packet_buffer_t *p)
+{
+	wfb_rx_release(&p->frame);
+	p->data = p->buf;
+}
+
+/*
+ * Moves every packet held in a ring block to its own storage, the blocks go back to the
+ * kernel. Done when the ring reader comes round to a held block
+ */
+static void
+unpin_ring_packets(wfb_rx_stream_t *rx)
+{
+	size_t b;
+	size_t i;
+
+	for (b = 0U; b < rx->cfg.block_buffers; b++) {
+		packet_buffer_t *pbl = rx->block_buffer_list[b].packet_buffer_list;
+
+		for (i = 0U; i < (WFB_FEC_MAX_PACKETS * 2U); i++) {
+			if (wfb_rx_frame_in_ring(&pbl[i].frame)) {
+				memcpy(pbl[i].buf, pbl[i].data, pbl[i].len);
+				release_packet_buffer(&pbl[i]);
+			}
+		}
+	}
 }
 
 static packet_buffer_t *
@@ -112,448 +122,655 @@ alloc_packet_buffer_list(size_t num_packets, size_t packet_length)
 
 /*=========================================================*/
 
+static void
+block_buffer_reset(block_buffer_t *rb)
+{
+	rb->block_num = -1;
+	rb->emitted = 0U;
+	rb->flushed = false;
+
+	packet_buffer_t *p = rb->packet_buffer_list;
+
+	size_t j;
+	for (j = 0; j < WFB_FEC_MAX_PACKETS * 2U; j++) {
+		release_packet_buffer(p);
+		p->valid = false;
+		p->crc_correct = false;
+		p->len = 0U;
+		p++;
+	}
+}
+
 static void
 block_buffer_list_reset(block_buffer_t *block_buffer_list, size_t block_buffer_list_len)
 {
 	size_t i;
-	block_buffer_t *rb = block_buffer_list;
 
 	for (i = 0U; i < block_buffer_list_len; i++) {
-		rb->block_num = -1;
+		block_buffer_reset(&block_buffer_list[i]);
+	}
+}
 
-		packet_buffer_t *p = rb->packet_buffer_list;
+/*
+ * Passes the payload of a data packet to the sink
+ */
+static void
+emit_packet(wfb_rx_stream_t *rx, const block_buffer_t *bb, size_t packet_num, uint8_t *packet,
+	    size_t packet_length, bool recovered)
+{
+	payload_header_t *ph = (payload_header_t *)packet;
+	size_t kbitrate = 0U;
 
-		size_t j;
-		for (j = 0; j < param_data_packets_per_block + param_fec_packets_per_block; j++) {
-			p->valid = false;
-			p->crc_correct = false;
-			p->len = 0U;
-			p++;
-		}
+	/*
+	 * If reconstruction fails, the data_length value is undefined
+	 *
+	 * Limit it to some sensible value
+	 */
+	if (ph->data_length > (packet_length - sizeof(payload_header_t))) {
+		ph->data_length = packet_length - sizeof(payload_header_t);
+	}
 
-		rb++;
+	if (rx->sink != NULL) {
+		wfb_rx_stream_data_t out = {
+		    .data = packet + sizeof(payload_header_t),
+		    .len = ph->data_length,
+		    .block_num = bb->block_num,
+		    .packet_num = packet_num,
+		    .recovered = recovered,
+		};
+
+		rx->sink(rx->sink_arg, &out);
+	}
+
+	now = svc_get_monotime();
+
+	rx->bytes_decoded += ph->data_length;
+
+	if ((now - prev_time) > (500ULL * TIME_MS)) {
+		prev_time = svc_get_monotime();
+
+		kbitrate = ((rx->bytes_decoded * 8) / 1024) * 2;
+		rx->rx_status.kbitrate = kbitrate;
+		rx->bytes_decoded = 0;
+
+		// log_dbg("kbitrate: %d", kbitrate);
 	}
 }
 
+/*
+ * Decodes a block, passes its data packets that were not passed yet and frees the slot
+ */
 static void
-process_payload(wfb_rx_stream_t *rx, const struct payload_data_t *pd,
-		block_buffer_t *block_buffer_list, wfb_rx_stream_packet_t *rx_data)
+flush_block(wfb_rx_stream_t *rx, block_buffer_t *bb)
 {
-	const wifi_packet_header_t *wph;
+	packet_buffer_t *packet_buffer_list = bb->packet_buffer_list;
 
-	int block_num;
-	int packet_num;
+	/* the block being flushed keeps its own profile */
+	const size_t data_packets = bb->fec.data_packets;
+	const size_t fec_packets = bb->fec.fec_packets;
+	size_t decode_length = 0U;
 	size_t i;
-	size_t kbitrate = 0U;
 
-	wph = (wifi_packet_header_t *)pd->data;
-	const char *data = (const char *)&wph[1U];
-	size_t data_len = pd->size - sizeof(wifi_packet_header_t);
+	rx->rx_status.received_block_cnt++;
 
 	/*
-	 * If aram_data_packets_per_block+param_fec_packets_per_block would be limited to powers of
-	 * two, this could be replaced by a logical AND operation
+	 * We have pointers to the packet buffers (to get information about CRC and
+	 * vadility), and raw data pointers for fec_decode
 	 */
-	block_num =
-	    wph->sequence_number / (param_data_packets_per_block + param_fec_packets_per_block);
+	packet_buffer_t *data_pkgs[WFB_FEC_MAX_PACKETS];
+	packet_buffer_t *fec_pkgs[WFB_FEC_MAX_PACKETS];
+	uint8_t *data_blocks[WFB_FEC_MAX_PACKETS];
+	uint8_t *fec_blocks[WFB_FEC_MAX_PACKETS];
 
-	// log_dbg("adap %d rec %x blk %x crc %d len %d", adapter_no, wph->sequence_number,
-	// block_num, crc_correct, data_len);
+	int datas_missing = 0, datas_corrupt = 0, fecs_missing = 0,
+	    fecs_corrupt = 0;
+	size_t di = 0U, fi = 0U;
 
 	/*
-	 * We have received a block number that exceeds the block numbers we have seen so far
-	 *
-	 * We need to make room for this new block, or we have received a block_num that is
-	 * several times smaller than the current window of buffers.
-	 *
-	 * This indicates that either the window is too small, or that the transmitter has been
-	 * restarted
+	 * First, split the received packets into data and FEC packets (FEC
+	 * packets follow the data ones), and count the damaged packets
 	 */
-	bool tx_restart = (int)((size_t)block_num + (128U * param_block_buffers)) < max_block_num;
-
-	if (((block_num > max_block_num) || tx_restart) && pd->crc_ok) {
-		if (tx_restart) {
-			rx->rx_status.tx_restart_cnt++;
-			rx->rx_status.received_block_cnt = 0U;
-			rx->rx_status.damaged_block_cnt = 0U;
-			rx->rx_status.received_packet_cnt = 0U;
-			rx->rx_status.lost_packet_cnt = 0U;
-			rx->rx_status.kbitrate = 0U;
-
-			size_t g;
-			for (g = 0; g < NL_MAX_IFACES; g++) {
-				rx->rx_status.adapter[g].received_packet_cnt = 0U;
-				rx->rx_status.adapter[g].wrong_crc_cnt = 0U;
-				rx->rx_status.adapter[g].current_signal_dbm = -126;
-				rx->rx_status.adapter[g].signal_good = 0U;
-			}
 
-			log_inf("TX re-start detected");
-			block_buffer_list_reset(block_buffer_list, param_block_buffers);
+	for (di = 0U; di < data_packets; di++) {
+		data_pkgs[di] = packet_buffer_list + di;
+		/* missing packets are recovered into their own storage */
+		data_blocks[di] = data_pkgs[di]->valid ? data_pkgs[di]->data : data_pkgs[di]->buf;
+
+		if (!data_pkgs[di]->valid) {
+			datas_missing++;
+		}
+
+		// if(data_pkgs[di]->valid && !data_pkgs[di]->crc_correct)
+		// datas_corrupt++; // not needed as we dont receive fcs
+		// fail frames
+	}
+
+	for (fi = 0U; fi < fec_packets; fi++) {
+		fec_pkgs[fi] = packet_buffer_list + data_packets + fi;
+
+		if (!fec_pkgs[fi]->valid) {
+			fecs_missing++;
 		}
 
+		// if(fec_pkgs[fi]->valid && !fec_pkgs[fi]->crc_correct)
+		// fecs_corrupt++; // not needed as we dont receive fcs fail
+		// frames
+	}
+
+	const int good_fecs_c = (int)fec_packets - fecs_missing - fecs_corrupt;
+	const int datas_missing_c = datas_missing;
+	const int datas_corrupt_c = datas_corrupt;
+	const int fecs_missing_c = fecs_missing;
+	// const int fecs_corrupt_c = fecs_corrupt;
+
+	uint32_t packets_lost_in_block = 0U;
+	// int good_fecs = good_fecs_c;
+
+	/*
+	 * The following three fields are infos for fec_decode
+	 */
+	unsigned int fec_block_nos[WFB_FEC_MAX_PACKETS];
+	unsigned int erased_blocks[WFB_FEC_MAX_PACKETS];
+	unsigned int nr_fec_blocks = 0;
+
+	if ((datas_missing_c + fecs_missing_c) > 0) {
+		packets_lost_in_block =
+		    (uint32_t)(datas_missing_c + fecs_missing_c);
+		rx->rx_status.lost_packet_cnt += (uint32_t)packets_lost_in_block;
+	}
+
+	rx->rx_status.received_packet_cnt +=
+	    data_packets + fec_packets - packets_lost_in_block;
+
+	packets_missing_last = packets_missing;
+	packets_missing = packets_lost_in_block;
+
+	if (packets_missing < packets_missing_last) {
 		/*
-		 * First, find the minimum block num in the buffers list. this will be the block
-		 * that we replace
+		 * If we have less missing packets than last time, ignore
 		 */
-		int min_block_num = INT32_MAX;
-		int min_block_num_idx = 0;
+		packets_missing = packets_missing_last;
+	}
 
-		for (i = 0U; i < param_block_buffers; i++) {
-			if (block_buffer_list[i].block_num < min_block_num) {
-				min_block_num = block_buffer_list[i].block_num;
-				min_block_num_idx = i;
-			}
-		}
+	pm_now = svc_get_monotime();
 
-		/*log_dbg("removing block %x at index %i for block %x", min_block_num,
-			min_block_num_idx, block_num);*/
+	if ((pm_now - pm_prev_time) > (220 * TIME_MS)) {
+		pm_prev_time = svc_get_monotime();
+		rx->rx_status.lost_per_block_cnt = packets_missing;
+		packets_missing = 0;
+		packets_missing_last = 0;
+	}
 
-		packet_buffer_t *packet_buffer_list =
-		    block_buffer_list[min_block_num_idx].packet_buffer_list;
+	fi = 0;
+	di = 0;
 
-		int last_block_num = block_buffer_list[min_block_num_idx].block_num;
+	/*
+	 * Look for missing DATA and replace them with good FECs
+	 */
+	while ((di < data_packets) && (fi < fec_packets)) {
+		/*
+		 * If this data is fine, we go to the next
+		 */
+		if (data_pkgs[di]->valid && data_pkgs[di]->crc_correct) {
+			di++;
+			continue;
+		}
 
-		if (last_block_num != -1) {
-			rx->rx_status.received_block_cnt++;
+		/*
+		 * If this DATA is corrupt and there are less good fecs than missing
+		 * datas we cannot do anything for this data
+		 *
+		 * Not needed right now, as we dont receive FCS failure frames from
+		 * the NIC anyway
+		 */
 
-			/*
-			 * We have pointers to the packet buffers (to get information about CRC and
-			 * vadility), and raw data pointers for fec_decode
-			 */
-			packet_buffer_t *data_pkgs[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-			packet_buffer_t *fec_pkgs[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-			uint8_t *data_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-			uint8_t *fec_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+		/*
+if (data_pkgs[di]->valid && !data_pkgs[di]->crc_correct && good_fecs <=
+datas_missing) { di++; continue;
+}
+*/
 
-			int datas_missing = 0, datas_corrupt = 0, fecs_missing = 0,
-			    fecs_corrupt = 0;
-			size_t di = 0U, fi = 0U;
+		/*
+		 * If this FEC is not received, we go on to the next
+		 */
+		if (!fec_pkgs[fi]->valid) {
+			fi++;
 
-			/*
-			 * First, split the received packets into data and FEC packets, and count
-			 * the damaged packets
-			 */
+			continue;
+		}
 
-			i = 0U;
-			while ((di < param_data_packets_per_block) ||
-			       (fi < param_fec_packets_per_block)) {
-				if (di < param_data_packets_per_block) {
-					data_pkgs[di] = packet_buffer_list + i++;
-					data_blocks[di] = data_pkgs[di]->data;
+		/*
+		 * If this FEC is corrupted and there are more lost packages than
+		 * good fecs we should replace this DATA even with this corrupted
+		 * FEC
+		 *
+		 * Not needed right now, as we dont receive FCS failure frames from
+		 * the NIC anyway
+		 */
 
-					if (!data_pkgs[di]->valid) {
-						datas_missing++;
-					}
+		/*
+if (!fec_pkgs[fi]->crc_correct && datas_missing > good_fecs) {
+    fi++;
+    continue;
+}
+*/
 
-					// if(data_pkgs[di]->valid && !data_pkgs[di]->crc_correct)
-					// datas_corrupt++; // not needed as we dont receive fcs
-					// fail frames
+		if (!data_pkgs[di]->valid) {
+			datas_missing--;
+		}
+		/* not needed as we dont receive fcs fail frames
+else if (!data_pkgs[di]->crc_correct) {
+    datas_corrupt--;
+}
+*/
 
-					di++;
-				}
+		/*
+		 * Not needed as we dont receive fcs fail frames
+		 */
 
-				if (fi < param_fec_packets_per_block) {
-					fec_pkgs[fi] = packet_buffer_list + i++;
+		/*
+if(fec_pkgs[fi]->crc_correct) {
+    good_fecs--;
+}
+*/
 
-					if (!fec_pkgs[fi]->valid) {
-						fecs_missing++;
-					}
+		/*
+		 * At this point, data is invalid and fec is good -> replace data
+		 * with fec
+		 */
+		erased_blocks[nr_fec_blocks] = di;
+		fec_block_nos[nr_fec_blocks] = fi;
+		fec_blocks[nr_fec_blocks] = fec_pkgs[fi]->data;
 
-					// if(fec_pkgs[fi]->valid && !fec_pkgs[fi]->crc_correct)
-					// fecs_corrupt++; // not needed as we dont receive fcs fail
-					// frames
+		di++;
+		fi++;
+		nr_fec_blocks++;
+	}
 
-					fi++;
+	int reconstruction_failed = datas_missing_c + datas_corrupt_c > good_fecs_c;
+	if (reconstruction_failed) {
+		/*
+		 * We did not have enough FEC packets to repair this block
+		 */
+		rx->rx_status.damaged_block_cnt++;
+		// fprintf(stderr, "Could not fully reconstruct block %x! Damage
+		// rate: %f (%d / %d blocks)\n", last_block_num, 1.0 *
+		// rx_status->damaged_block_cnt / rx_status->received_block_cnt,
+		// rx_status->damaged_block_cnt, rx_status->received_block_cnt);
+		// debug_print("Data mis: %d\tData corr: %d\tFEC mis: %d\tFEC corr:
+		// %d\n", datas_missing_c, datas_corrupt_c, fecs_missing_c,
+		// fecs_corrupt_c);
+	}
+
+	/*
+	 * Packets come at their real length. The parity covers the longest data packet of the
+	 * block, the shorter ones are zero-extended to it. The frames they are in have no room
+	 * for that, so these get copied to their own storage
+	 */
+	if (nr_fec_blocks > 0U) {
+		decode_length = fec_pkgs[fec_block_nos[0]]->len;
+
+		for (i = 0U; i < data_packets; i++) {
+			if (data_pkgs[i]->valid && (data_pkgs[i]->len < decode_length)) {
+				if (data_blocks[i] != data_pkgs[i]->buf) {
+					memcpy(data_pkgs[i]->buf, data_blocks[i],
+					       data_pkgs[i]->len);
+					data_blocks[i] = data_pkgs[i]->buf;
 				}
-			}
 
-			const int good_fecs_c =
-			    (int)param_fec_packets_per_block - fecs_missing - fecs_corrupt;
-			const int datas_missing_c = datas_missing;
-			const int datas_corrupt_c = datas_corrupt;
-			const int fecs_missing_c = fecs_missing;
-			// const int fecs_corrupt_c = fecs_corrupt;
-
-			uint32_t packets_lost_in_block = 0U;
-			// int good_fecs = good_fecs_c;
-
-			/*
-			 * The following three fields are infos for fec_decode
-			 */
-			unsigned int fec_block_nos[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-			unsigned int erased_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-			unsigned int nr_fec_blocks = 0;
-
-			if ((datas_missing_c + fecs_missing_c) > 0) {
-				packets_lost_in_block =
-				    (uint32_t)(datas_missing_c + fecs_missing_c);
-				rx->rx_status.lost_packet_cnt += (uint32_t)packets_lost_in_block;
+				memset(data_blocks[i] + data_pkgs[i]->len, 0,
+				       decode_length - data_pkgs[i]->len);
 			}
+		}
 
-			rx->rx_status.received_packet_cnt += param_data_packets_per_block +
-							     param_fec_packets_per_block -
-							     packets_lost_in_block;
+		/*
+		 * Decode data and write it to STDOUT
+		 *
+		 * This is where the video data gets moved to the rest of the system after
+		 * reception
+		 */
+		fec_decode((unsigned int)decode_length, data_blocks, data_packets, fec_blocks,
+			   fec_block_nos, erased_blocks, nr_fec_blocks);
+	}
 
-			packets_missing_last = packets_missing;
-			packets_missing = packets_lost_in_block;
+	/*
+	 * Packets already passed through in low latency mode are skipped
+	 */
+	for (i = bb->emitted; i < data_packets; i++) {
+		if (data_pkgs[i]->valid) {
+			emit_packet(rx, bb, i, data_blocks[i], data_pkgs[i]->len, false);
+		} else if (!reconstruction_failed) {
+			emit_packet(rx, bb, i, data_blocks[i], decode_length, true);
+		}
+	}
 
-			if (packets_missing < packets_missing_last) {
-				/*
-				 * If we have less missing packets than last time, ignore
-				 */
-				packets_missing = packets_missing_last;
-			}
+	if (bb->block_num > rx->last_block_num) {
+		rx->last_block_num = bb->block_num;
+	}
 
-			pm_now = svc_get_monotime();
+	/*
+	 * The frames go back to the capture. The flags stay until the slot is reused, to tell
+	 * late packets from duplicates
+	 */
+	for (i = 0U; i < (data_packets + fec_packets); i++) {
+		release_packet_buffer(&packet_buffer_list[i]);
+	}
 
-			if ((pm_now - pm_prev_time) > (220 * TIME_MS)) {
-				pm_prev_time = svc_get_monotime();
-				rx->rx_status.lost_per_block_cnt = packets_missing;
-				packets_missing = 0;
-				packets_missing_last = 0;
-			}
+	bb->flushed = true;
+}
 
-			fi = 0;
-			di = 0;
-
-			/*
-			 * Look for missing DATA and replace them with good FECs
-			 */
-			while ((di < param_data_packets_per_block) &&
-			       (fi < param_fec_packets_per_block)) {
-				/*
-				 * If this data is fine, we go to the next
-				 */
-				if (data_pkgs[di]->valid && data_pkgs[di]->crc_correct) {
-					di++;
-					continue;
-				}
+/*
+ * Returns the pending block with the lowest number, or NULL if all slots are free
+ */
+static block_buffer_t *
+oldest_block(wfb_rx_stream_t *rx)
+{
+	block_buffer_t *oldest = NULL;
+	size_t i;
 
-				/*
-				 * If this DATA is corrupt and there are less good fecs than missing
-				 * datas we cannot do anything for this data
-				 *
-				 * Not needed right now, as we dont receive FCS failure frames from
-				 * the NIC anyway
-				 */
+	for (i = 0U; i < rx->cfg.block_buffers; i++) {
+		block_buffer_t *bb = &rx->block_buffer_list[i];
 
-				/*
-		if (data_pkgs[di]->valid && !data_pkgs[di]->crc_correct && good_fecs <=
-		datas_missing) { di++; continue;
+		if ((bb->block_num != -1) && !bb->flushed &&
+		    ((oldest == NULL) || (bb->block_num < oldest->block_num))) {
+			oldest = bb;
 		}
-		*/
+	}
 
-				/*
-				 * If this FEC is not received, we go on to the next
-				 */
-				if (!fec_pkgs[fi]->valid) {
-					fi++;
+	return oldest;
+}
 
-					continue;
-				}
+/*
+ * Flushes the pending blocks up to block_num in order. Blocks not received up to there are
+ * given up
+ */
+static void
+flush_blocks_upto(wfb_rx_stream_t *rx, int block_num)
+{
+	block_buffer_t *bb;
+
+	while (((bb = oldest_block(rx)) != NULL) && (bb->block_num <= block_num)) {
+		flush_block(rx, bb);
+	}
+
+	if (block_num > rx->last_block_num) {
+		rx->last_block_num = block_num;
+	}
+}
 
-				/*
-				 * If this FEC is corrupted and there are more lost packages than
-				 * good fecs we should replace this DATA even with this corrupted
-				 * FEC
-				 *
-				 * Not needed right now, as we dont receive FCS failure frames from
-				 * the NIC anyway
-				 */
+/*
+ * Flushes the oldest blocks while there is nothing more to wait for: the block is complete,
+ * or a newer block has started and this one is decodable, or its deadline has passed
+ */
+static void
+flush_ready_blocks(wfb_rx_stream_t *rx, uint64_t ts)
+{
+	block_buffer_t *bb;
 
-				/*
-		if (!fec_pkgs[fi]->crc_correct && datas_missing > good_fecs) {
-		    fi++;
-		    continue;
+	while ((bb = oldest_block(rx)) != NULL) {
+		const size_t packets = bb->fec.data_packets + bb->fec.fec_packets;
+		size_t received = 0U;
+		size_t i;
+
+		for (i = 0U; i < packets; i++) {
+			if (bb->packet_buffer_list[i].valid) {
+				received++;
+			}
 		}
-		*/
 
-				if (!data_pkgs[di]->valid) {
-					datas_missing--;
-				}
-				/* not needed as we dont receive fcs fail frames
-		else if (!data_pkgs[di]->crc_correct) {
-		    datas_corrupt--;
+		if ((ts - bb->last_ts) > rx->cfg.flush_timeout) {
+			rx->rx_status.timeout_flush_cnt++;
+		} else if (received < packets) {
+			if ((bb->block_num == rx->max_block_num) ||
+			    (received < bb->fec.data_packets)) {
+				break;
+			}
 		}
-		*/
 
-				/*
-				 * Not needed as we dont receive fcs fail frames
-				 */
+		flush_blocks_upto(rx, bb->block_num);
+	}
+}
 
-				/*
-		if(fec_pkgs[fi]->crc_correct) {
-		    good_fecs--;
+/*
+ * Low latency mode: passes data packets through as soon as all the previous ones are here,
+ * across the blocks of the window. Only the gaps wait for FEC at the block flush
+ */
+static void
+passthrough_blocks(wfb_rx_stream_t *rx)
+{
+	int block_num;
+
+	for (block_num = rx->last_block_num + 1; block_num <= rx->max_block_num; block_num++) {
+		block_buffer_t *bb =
+		    &rx->block_buffer_list[(size_t)block_num % rx->cfg.block_buffers];
+		packet_buffer_t *pbl = bb->packet_buffer_list;
+
+		if (bb->block_num != block_num) {
+			break;
 		}
-		*/
 
-				/*
-				 * At this point, data is invalid and fec is good -> replace data
-				 * with fec
-				 */
-				erased_blocks[nr_fec_blocks] = di;
-				fec_block_nos[nr_fec_blocks] = fi;
-				fec_blocks[nr_fec_blocks] = fec_pkgs[fi]->data;
+		while ((bb->emitted < bb->fec.data_packets) && pbl[bb->emitted].valid) {
+			emit_packet(rx, bb, bb->emitted, pbl[bb->emitted].data,
+				    pbl[bb->emitted].len, false);
+			bb->emitted++;
+		}
 
-				di++;
-				fi++;
-				nr_fec_blocks++;
-			}
+		if (bb->emitted < bb->fec.data_packets) {
+			break;
+		}
+	}
+}
 
-			int reconstruction_failed = datas_missing_c + datas_corrupt_c > good_fecs_c;
-			if (reconstruction_failed) {
-				/*
-				 * We did not have enough FEC packets to repair this block
-				 */
-				rx->rx_status.damaged_block_cnt++;
-				// fprintf(stderr, "Could not fully reconstruct block %x! Damage
-				// rate: %f (%d / %d blocks)\n", last_block_num, 1.0 *
-				// rx_status->damaged_block_cnt / rx_status->received_block_cnt,
-				// rx_status->damaged_block_cnt, rx_status->received_block_cnt);
-				// debug_print("Data mis: %d\tData corr: %d\tFEC mis: %d\tFEC corr:
-				// %d\n", datas_missing_c, datas_corrupt_c, fecs_missing_c,
-				// fecs_corrupt_c);
-			}
+static void
+process_payload(wfb_rx_stream_t *rx, const struct payload_data_t *pd)
+{
+	const wifi_packet_header_t *wph;
+	wfb_fec_profile_t fec;
 
-			/*
-			 * Decode data and write it to STDOUT
-			 *
-			 * This is where the video data gets moved to the rest of the system after
-			 * reception
-			 */
-			fec_decode((unsigned int)param_packet_length, data_blocks,
-				   param_data_packets_per_block, fec_blocks, fec_block_nos,
-				   erased_blocks, nr_fec_blocks);
-
-			for (i = 0U; i < param_data_packets_per_block; i++) {
-				payload_header_t *ph = (payload_header_t *)data_blocks[i];
-
-				if (!reconstruction_failed || data_pkgs[i]->valid) {
-					/*
-					 * If reconstruction fails, the data_length value is
-					 * undefined
-					 *
-					 * Limit it to some sensible value
-					 */
-					if (ph->data_length > param_packet_length) {
-						ph->data_length = param_packet_length;
-					}
-
-					memcpy(&rx_data->data[rx_data->bytes],
-					       data_blocks[i] + sizeof(payload_header_t),
-					       ph->data_length);
-					rx_data->bytes += (int)ph->data_length;
-
-					// write(STDOUT_FILENO, data_blocks[i] +
-					// sizeof(payload_header_t), ph->data_length);
-					// fflush(stdout);
-
-					now = svc_get_monotime();
-
-					rx->bytes_decoded += ph->data_length;
-
-					if ((now - prev_time) > (500ULL * TIME_MS)) {
-						prev_time = svc_get_monotime();
-
-						kbitrate = ((rx->bytes_decoded * 8) / 1024) * 2;
-						rx->rx_status.kbitrate = kbitrate;
-						rx->bytes_decoded = 0;
-
-						// log_dbg("kbitrate: %d", kbitrate);
-					}
-				}
-			}
+	int block_num;
+	size_t packet_num;
+	size_t packet_length;
+	uint64_t ts = svc_get_monotime();
 
-			/*
-			 * Reset buffers
-			 */
-			for (i = 0; i < param_data_packets_per_block + param_fec_packets_per_block;
-			     i++) {
-				packet_buffer_t *p = packet_buffer_list + i;
-				p->valid = 0;
-				p->crc_correct = 0;
-				p->len = 0;
-			}
+	if (pd->size < sizeof(wifi_packet_header_t)) {
+		return;
+	}
+
+	wph = (wifi_packet_header_t *)pd->data;
+	const char *data = (const char *)&wph[1U];
+	size_t data_len = pd->size - sizeof(wifi_packet_header_t);
+
+	/*
+	 * The FEC profile comes with every packet, drop the ones that do not make sense
+	 */
+	fec.data_packets = wph->data_packets;
+	fec.fec_packets = wph->fec_packets;
+	fec.packet_length = wph->packet_length;
+
+	if (!wfb_fec_profile_valid(&fec)) {
+		return;
+	}
+
+	packet_num = wph->packet_num;
+	if (packet_num >= (fec.data_packets + fec.fec_packets)) {
+		return;
+	}
+
+	/*
+	 * Packets are sent at their real length: a data packet is as long as its payload, a fec
+	 * packet as the longest data packet of the block
+	 */
+	if (packet_num < fec.data_packets) {
+		const payload_header_t *ph = (const payload_header_t *)data;
+
+		if ((data_len < sizeof(payload_header_t)) ||
+		    (ph->data_length > (data_len - sizeof(payload_header_t)))) {
+			return;
 		}
 
-		block_buffer_list[min_block_num_idx].block_num = block_num;
-		max_block_num = block_num;
+		packet_length = sizeof(payload_header_t) + ph->data_length;
+	} else {
+		packet_length = data_len;
+	}
+
+	if (packet_length > fec.packet_length) {
+		return;
 	}
 
+	block_num = (int)(wph->block_num & INT32_MAX);
+
+	// log_dbg("adap %d blk %x pkt %d crc %d len %d", adapter_no, block_num,
+	// packet_num, crc_correct, data_len);
+
 	/*
-	 * Find the buffer into which we have to write this packet
+	 * We have received a block_num that is several times smaller than the current window of
+	 * buffers.
+	 *
+	 * This indicates that either the window is too small, or that the transmitter has been
+	 * restarted
 	 */
-	block_buffer_t *rbb = block_buffer_list;
-	for (i = 0; i < param_block_buffers; i++) {
-		if (rbb->block_num == block_num) {
-			break;
+	bool tx_restart =
+	    (int)((size_t)block_num + (128U * rx->cfg.block_buffers)) < rx->max_block_num;
+
+	if (tx_restart && pd->crc_ok) {
+		rx->rx_status.tx_restart_cnt++;
+		rx->rx_status.received_block_cnt = 0U;
+		rx->rx_status.damaged_block_cnt = 0U;
+		rx->rx_status.received_packet_cnt = 0U;
+		rx->rx_status.lost_packet_cnt = 0U;
+		rx->rx_status.late_packet_cnt = 0U;
+		rx->rx_status.duplicate_packet_cnt = 0U;
+		rx->rx_status.timeout_flush_cnt = 0U;
+		rx->rx_status.kbitrate = 0U;
+
+		size_t g;
+		for (g = 0; g < NL_MAX_IFACES; g++) {
+			rx->rx_status.adapter[g].received_packet_cnt = 0U;
+			rx->rx_status.adapter[g].wrong_crc_cnt = 0U;
+			rx->rx_status.adapter[g].current_signal_dbm = -126;
+			rx->rx_status.adapter[g].signal_good = 0U;
 		}
-		rbb++;
+
+		log_inf("TX re-start detected");
+		block_buffer_list_reset(rx->block_buffer_list, rx->cfg.block_buffers);
+		rx->max_block_num = -1;
+	}
+
+	if (rx->max_block_num == -1) {
+		/* nothing before the first block we see */
+		rx->last_block_num = block_num - 1;
 	}
 
+	block_buffer_t *rbb = &rx->block_buffer_list[(size_t)block_num % rx->cfg.block_buffers];
+
 	/*
-	 * Check if we have actually found the corresponding block. this could not be the case due
-	 * to a corrupt packet
+	 * Blocks already flushed (or given up) can not take packets any more
 	 */
-	if (i != param_block_buffers) {
-		packet_buffer_t *pbl = rbb->packet_buffer_list;
+	if (block_num <= rx->last_block_num) {
+		if ((rbb->block_num == block_num) && rbb->packet_buffer_list[packet_num].valid) {
+			rx->rx_status.duplicate_packet_cnt++;
+		} else {
+			rx->rx_status.late_packet_cnt++;
+		}
+
+		return;
+	}
 
+	/*
+	 * We have received a block number that exceeds the block numbers we have seen so far.
+	 * The window moves forward, the blocks falling out of it are flushed
+	 */
+	if ((block_num > rx->max_block_num) && pd->crc_ok) {
+		flush_blocks_upto(rx, block_num - (int)rx->cfg.block_buffers);
+		rx->max_block_num = block_num;
+	}
+
+	/*
+	 * Every block of the window has its own slot, the first packet of a block takes it
+	 */
+	if (rbb->block_num != block_num) {
 		/*
-		 * If retr_block_size would be limited to powers of two, this could be replace by a
-		 * locical and operation
+		 * The block is not in the window, this could be the case due to a corrupt packet
 		 */
-		packet_num = wph->sequence_number %
-			     (param_data_packets_per_block + param_fec_packets_per_block);
+		if ((block_num > rx->max_block_num) || !pd->crc_ok ||
+		    ((rbb->block_num != -1) && !rbb->flushed)) {
+			return;
+		}
+
+		block_buffer_reset(rbb);
+		rbb->block_num = block_num;
+		rbb->fec = fec;
+	}
+
+	packet_buffer_t *pbl = rbb->packet_buffer_list;
+
+	/*
+	 * A block never changes its profile, a mismatch means a stale or foreign packet
+	 */
+	if (memcmp(&rbb->fec, &fec, sizeof(wfb_fec_profile_t)) != 0) {
+		return;
+	}
+
+	/*
+	 * Only overwrite packets where the checksum is not yet correct. otherwise the packets are
+	 * already received correctly
+	 */
+	if (pbl[packet_num].crc_correct == 0) {
+		packet_buffer_t *pb = &pbl[packet_num];
 
 		/*
-		 * Only overwrite packets where the checksum is not yet correct. otherwise the
-		 * packets are already received correctly
+		 * The packet stays in the captured frame until the block is flushed. Copied only
+		 * if the frame can not be held
 		 */
-		if (pbl[packet_num].crc_correct == 0) {
-			memcpy(pbl[packet_num].data, data, data_len);
-			pbl[packet_num].len = data_len;
-			pbl[packet_num].valid = 1;
-			pbl[packet_num].crc_correct = pd->crc_ok;
-
-			/// fprintf(stderr, "rx INFO:
-			/// pbl[packet_numer].crc_correct=0");
+		release_packet_buffer(pb);
+		pb->data = (uint8_t *)wfb_rx_hold(&rx->wfb_rx, pd->adapter,
+						  (const uint8_t *)data, &pb->frame);
+		if (pb->data == NULL) {
+			pb->data = pb->buf;
+			memcpy(pb->data, data, packet_length);
 		}
+
+		pbl[packet_num].len = packet_length;
+		pbl[packet_num].valid = 1;
+		pbl[packet_num].crc_correct = pd->crc_ok;
+		rbb->last_ts = ts;
+
+		/// fprintf(stderr, "rx INFO:
+		/// pbl[packet_numer].crc_correct=0");
+	} else {
+		/* the same packet through another adapter */
+		rx->rx_status.duplicate_packet_cnt++;
+	}
+
+	flush_ready_blocks(rx, ts);
+
+	if (rx->cfg.low_latency) {
+		passthrough_blocks(rx);
 	}
 }
 
 static int
-wfb_rx_stream_interface(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data, size_t adapter_no)
+wfb_rx_stream_interface(wfb_rx_stream_t *rx, size_t adapter_no)
 {
 	int result = 0;
 
 	monitor_interface_t *interface = &rx->wfb_rx.iface[adapter_no];
 
-	struct pcap_pkthdr *ppcapPacketHeader = NULL;
-
-	struct ieee80211_radiotap_iterator rti;
-	// PENUMBRA_RADIOTAP_DATA prd;
+	wfb_rx_radiotap_t rt;
 	uint8_t *pu8Payload = NULL;
+	size_t packet_len = 0U;
 	ssize_t bytes;
 	int retval;
 	size_t u16HeaderLen;
 	struct payload_data_t pd;
+	bool fcs = false;
 
 	// receive
-	retval = pcap_next_ex(interface->ppcap, &ppcapPacketHeader, (const u_char **)&pu8Payload);
-	if (retval < 0) {
-		if (strcmp("The interface went down", pcap_geterr(interface->ppcap)) == 0) {
-			log_err("rx: The interface went down");
-			exit(9);
-		} else {
-			log_err("rx: %s", pcap_geterr(interface->ppcap));
-			exit(2);
-		}
-	}
+	retval = wfb_rx_next(interface, (const uint8_t **)&pu8Payload, &packet_len);
 
 	if (retval != 1) {
 		// exit(1);
-		return 1;
+		return 0;
 	}
 
 	/*
@@ -579,15 +796,15 @@ wfb_rx_stream_interface(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data, si
 		break;
 	}
 
-	// log_dbg("ppcapPacketHeader->len: %d", ppcapPacketHeader->len);
-	if (ppcapPacketHeader->len < (bpf_u_int32)(u16HeaderLen + interface->n80211HeaderLength)) {
-		log_err("ppcapheaderlen < u16headerlen+n80211headerlen: "
-			"ppcapPacketHeader->len: %d",
-			ppcapPacketHeader->len);
+	// log_dbg("packet_len: %d", packet_len);
+	if (packet_len < (u16HeaderLen + interface->n80211HeaderLength)) {
+		log_err("packet_len < u16headerlen+n80211headerlen: "
+			"packet_len: %zu",
+			packet_len);
 		exit(1);
 	}
 
-	bytes = (ssize_t)(ppcapPacketHeader->len - (u16HeaderLen + interface->n80211HeaderLength));
+	bytes = (ssize_t)(packet_len - (u16HeaderLen + interface->n80211HeaderLength));
 	// log_dbg("bytes: %d", bytes);
 	if (bytes < 0) {
 		log_err("bytes < 0: bytes: %d", bytes);
@@ -595,97 +812,51 @@ wfb_rx_stream_interface(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data, si
 	}
 	pd.size = (size_t)bytes;
 
-	if (ieee80211_radiotap_iterator_init(&rti, (struct ieee80211_radiotap_header *)pu8Payload,
-					     (int)ppcapPacketHeader->len) < 0) {
-		log_err("radiotap_iterator_init < 0");
+	if (wfb_rx_radiotap(interface, pu8Payload, packet_len, &rt) < 0) {
+		log_err("broken radiotap header");
 		exit(1);
 	}
 
-	// int dbm = -127;
-
-	while (ieee80211_radiotap_iterator_next(&rti) == 0) {
-		switch (rti.this_arg_index) {
-		case IEEE80211_RADIOTAP_RATE:
-			// we don't use this radiotap info right now
-			// prd.m_nRate = (*rti.this_arg);
-			break;
-		case IEEE80211_RADIOTAP_CHANNEL:
-			// we don't use this radiotap info right now
-			// prd.m_nChannel = le16_to_cpu(*((u16 *)rti.this_arg));
-			// prd.m_nChannelFlags = le16_to_cpu(*((u16 *)(rti.this_arg + 2)));
-			break;
-		case IEEE80211_RADIOTAP_FLAGS:
-			// prd.m_nRadiotapFlags = *rti.this_arg;
-			break;
-		case IEEE80211_RADIOTAP_ANTENNA:
-			// ant[adapter_no] = (int8_t) (*rti.this_arg);
-			// log_dbg("Ant: %d", ant[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_DB_ANTSIGNAL:
-			// db[adapter_no] = (int8_t) (*rti.this_arg);
-			// log_dbg("DB: %d", db[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_DBM_ANTNOISE:
-			// dbm_noise[adapter_no] = (int8_t) (*rti.this_arg);
-			// log_dbg("DBM Noise: %d", dbm_noise[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_LOCK_QUALITY:
-			// quality[adapter_no] = (int16_t) (*rti.this_arg);
-			// log_dbg("Quality: %d", quality[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_TSFT:
-			// tsft[adapter_no] = (int64_t) (*rti.this_arg);
-			// log_dbg("TSFT: %d", tsft[adapter_no]);
-			break;
-		case IEEE80211_RADIOTAP_DBM_ANTSIGNAL: {
-			// we don't use this radiotap info right now
-			// rx_status->adapter[adapter_no].current_signal_dbm =
-			// (int8_t)(*rti.this_arg);
-
-			dbm_last[adapter_no] = dbm[adapter_no];
-			dbm[adapter_no] = (int8_t)(*rti.this_arg);
+	fcs = ((rt.flags & IEEE80211_RADIOTAP_F_FCS) != 0U);
 
-			if (dbm[adapter_no] > dbm_last[adapter_no]) { // if we have a better signal
-								      // than last time, ignore
-				dbm[adapter_no] = dbm_last[adapter_no];
-			}
-
-			dbm_ts_now[adapter_no] = svc_get_monotime();
-
-			if (dbm_ts_now[adapter_no] - dbm_ts_prev[adapter_no] > 220ULL * TIME_MS) {
-				dbm_ts_prev[adapter_no] = svc_get_monotime();
+	size_t s;
+	for (s = 0U; s < rt.signals; s++) {
+		dbm_last[adapter_no] = dbm[adapter_no];
+		dbm[adapter_no] = rt.signal[s];
 
-				rx->rx_status.adapter[adapter_no].current_signal_dbm =
-				    dbm[adapter_no];
+		if (dbm[adapter_no] > dbm_last[adapter_no]) { // if we have a better signal
+							      // than last time, ignore
+			dbm[adapter_no] = dbm_last[adapter_no];
+		}
 
-				dbm[adapter_no] = 99;
-				dbm_last[adapter_no] = 99;
+		dbm_ts_now[adapter_no] = svc_get_monotime();
 
-				/*log_dbg("miss: %d   last: %d", packets_missing,
-					packets_missing_last);*/
-			}
+		if (dbm_ts_now[adapter_no] - dbm_ts_prev[adapter_no] > 220ULL * TIME_MS) {
+			dbm_ts_prev[adapter_no] = svc_get_monotime();
 
-		} break;
+			rx->rx_status.adapter[adapter_no].current_signal_dbm = dbm[adapter_no];
 
-		default:
-			/* do nothing */
-			break;
+			dbm[adapter_no] = 99;
+			dbm_last[adapter_no] = 99;
 		}
 	}
 
 	pd.data = &pu8Payload[u16HeaderLen + interface->n80211HeaderLength];
 
 	/*
-	 * Ralink and Atheros both always supply the FCS to userspace, no need to check
+	 * Ralink and Atheros both always supply the FCS to userspace. Packets have their real
+	 * length now, so it must not be taken for payload
 	 */
-	// if (prd.m_nRadiotapFlags & IEEE80211_RADIOTAP_F_FCS)
-	// bytes -= 4;
+	if (fcs && (pd.size >= 4U)) {
+		pd.size -= 4U;
+	}
 
 	/*
 	 * TODO: disable checksum handling in process_payload(), not needed since we have fscfail
 	 * disabled
 	 */
 	pd.crc_ok = true;
+	pd.adapter = adapter_no;
 
 	rx->rx_status.adapter[adapter_no].received_packet_cnt++;
 
@@ -729,17 +900,31 @@ wfb_rx_stream_interface(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data, si
 		shm_map_write(&rx->status_shm, &rx->rx_status, sizeof(wifibroadcast_rx_status_t));
 	}
 
-	process_payload(rx, &pd, rx->block_buffer_list, rx_data);
+	process_payload(rx, &pd);
+
+	result = 1;
 
 	return result;
 }
 
 int
-wfb_rx_stream_init(wfb_rx_stream_t *rx, int port)
+wfb_rx_stream_init(wfb_rx_stream_t *rx, int port, const wfb_rx_stream_cfg_t *cfg)
 {
 	int result = 0;
 
 	do {
+		if (cfg->block_buffers == 0U) {
+			log_err("rx: at least one block buffer is needed");
+			result = 1;
+			break;
+		}
+
+		rx->cfg = *cfg;
+		rx->sink = NULL;
+		rx->sink_arg = NULL;
+		rx->max_block_num = -1;
+		rx->last_block_num = -1;
+
 		if (!shm_map_init("shm_rx_status", sizeof(wifibroadcast_rx_status_t))) {
 			result = 1;
 			break;
@@ -752,6 +937,12 @@ wfb_rx_stream_init(wfb_rx_stream_t *rx, int port)
 
 		memset(&rx->rx_status, 0, sizeof(wifibroadcast_rx_status_t));
 
+		rx->wfb_rx.backend = cfg->backend;
+		rx->wfb_rx.ring = cfg->ring;
+		rx->wfb_rx.batch = cfg->batch;
+		/* every packet of the window may hold its frame */
+		rx->wfb_rx.hold_frames = cfg->block_buffers * WFB_FEC_MAX_PACKETS * 2U;
+
 		result = wfb_rx_init(&rx->wfb_rx, port);
 		if (result) {
 			break;
@@ -767,7 +958,7 @@ wfb_rx_stream_init(wfb_rx_stream_t *rx, int port)
 
 		fec_init();
 
-		rx->block_buffer_list = malloc(sizeof(block_buffer_t) * param_block_buffers);
+		rx->block_buffer_list = malloc(sizeof(block_buffer_t) * cfg->block_buffers);
 		if (rx->block_buffer_list == NULL) {
 			log_err("malloc() failed");
 			result = 1;
@@ -775,19 +966,25 @@ wfb_rx_stream_init(wfb_rx_stream_t *rx, int port)
 		}
 
 		size_t i;
-		for (i = 0; i < param_block_buffers; i++) {
-			rx->block_buffer_list[i].block_num = -1;
-			rx->block_buffer_list[i].packet_buffer_list = alloc_packet_buffer_list(
-			    param_data_packets_per_block + param_fec_packets_per_block,
-			    MAX_PACKET_LENGTH);
+		for (i = 0; i < cfg->block_buffers; i++) {
+			rx->block_buffer_list[i].packet_buffer_list =
+			    alloc_packet_buffer_list(WFB_FEC_MAX_PACKETS * 2U, MAX_PACKET_LENGTH);
+			block_buffer_reset(&rx->block_buffer_list[i]);
 		}
 	} while (false);
 
 	return result;
 }
 
+void
+wfb_rx_stream_sink(wfb_rx_stream_t *rx, wfb_rx_stream_sink_t sink, void *arg)
+{
+	rx->sink = sink;
+	rx->sink_arg = arg;
+}
+
 int
-wfb_rx_stream(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data)
+wfb_rx_stream(wfb_rx_stream_t *rx)
 {
 	int result = 0;
 
@@ -814,31 +1011,58 @@ wfb_rx_stream(wfb_rx_stream_t *rx, wfb_rx_stream_packet_t *rx_data)
 		}
 	}
 
-	struct timeval to;
-	to.tv_sec = 0;
-	to.tv_usec = 1e5; // 100ms timeout
-	fd_set readset;
-	FD_ZERO(&readset);
-	int nfds = 0;
+	/*
+	 * 100ms timeout, shorter if a pending block reaches its deadline before
+	 */
+	uint64_t timeout = 100ULL * TIME_MS;
+	uint64_t ts = svc_get_monotime();
+	block_buffer_t *oldest = oldest_block(rx);
+
+	if (oldest != NULL) {
+		uint64_t deadline = oldest->last_ts + rx->cfg.flush_timeout;
 
-	for (i = 0U; i < rx->wfb_rx.count; i++) {
-		FD_SET(rx->wfb_rx.iface[i].selectable_fd, &readset);
-		if (rx->wfb_rx.iface[i].selectable_fd > nfds) {
-			nfds = rx->wfb_rx.iface[i].selectable_fd;
+		if (deadline <= ts) {
+			timeout = 0ULL;
+		} else if ((deadline - ts) < timeout) {
+			timeout = deadline - ts + TIME_MS;
 		}
 	}
 
-	result = select(nfds + 1, &readset, NULL, NULL, &to);
+	result = 0;
+	if (rx->wfb_rx.ready == 0U) {
+		result = wfb_rx_wait(&rx->wfb_rx, (int)(timeout / TIME_MS));
+	}
 
-	if (result > 0) {
-		for (i = 0U; i < rx->wfb_rx.count; i++) {
-			if (FD_ISSET(rx->wfb_rx.iface[i].selectable_fd, &readset)) {
-				result = wfb_rx_stream_interface(rx, rx_data, i);
-				// rx_data->adapter = i;
-				break;
-			}
+	/*
+	 * Drain the ready adapters in turn, one packet from each, within the budget
+	 */
+	size_t budget = rx->cfg.rx_budget;
+	size_t packets = 0U;
+
+	while ((result >= 0) && (packets < budget) && wfb_rx_ready(&rx->wfb_rx, &i)) {
+		if (wfb_rx_stream_interface(rx, i) > 0) {
+			packets++;
+		} else {
+			wfb_rx_drained(&rx->wfb_rx, i);
 		}
 	}
 
+	if (result >= 0) {
+		result = (int)packets;
+	}
+
+	if (wfb_rx_stalled(&rx->wfb_rx)) {
+		unpin_ring_packets(rx);
+	}
+
+	/*
+	 * Deadline flush, also when nothing is received
+	 */
+	flush_ready_blocks(rx, svc_get_monotime());
+
+	if (rx->cfg.low_latency) {
+		passthrough_blocks(rx);
+	}
+
 	return result;
 }
@@ -31,34 +31,15 @@
 #include <sys/time.h>
 
 #include <log/log.h>
+#include <svc/svc.h>
 #include <wfb/wfb_tx.h>
 
-/* header buffer for atheros */
-static uint8_t headers_atheros[40];
-/* header buffer for ralink */
-static uint8_t headers_ralink[40];
-/* header buffer for Realtek */
-static uint8_t headers_Realtek[40];
-
-static size_t headers_atheros_len = 0;
-static size_t headers_ralink_len = 0;
-static size_t headers_Realtek_len = 0;
-
-/* wifi packet to be sent (263 + len and seq + radiotap and ieee headers) */
-static uint8_t packet_buffer_ath[402];
-/* wifi packet to be sent (263 + len and seq + radiotap and ieee headers) */
-static uint8_t packet_buffer_ral[402];
-/* wifi packet to be sent (263 + len and seq + radiotap and ieee headers) */
-static uint8_t packet_buffer_rea[402];
-
 /* telemetry frame header consisting of seqnr and payload length */
 struct header_s {
 	uint32_t seqnumber;
 	uint16_t length;
 } __attribute__((__packed__));
 
-static struct header_s header;
-
 int
 wfb_open_sock(const if_desc_t *iface)
 {
@@ -103,13 +84,14 @@ wfb_open_sock(const if_desc_t *iface)
 	return sock;
 }
 
-static uint8_t u8aRadiotapHeader[] = {0x00, 0x00,	      /**< @brief radiotap version */
-				      0x0c, 0x00,	      /**< @brief radiotap header length */
-				      0x04, 0x80, 0x00, 0x00, /**< @brief radiotap present flags */
-				      0x00, /**< @brief datarate (will be overwritten later) */
-				      0x00, 0x00, 0x00};
+static const uint8_t u8aRadiotapHeader[] = {
+    0x00, 0x00,		    /**< @brief radiotap version */
+    0x0c, 0x00,		    /**< @brief radiotap header length */
+    0x04, 0x80, 0x00, 0x00, /**< @brief radiotap present flags */
+    0x00,		    /**< @brief datarate (will be overwritten later) */
+    0x00, 0x00, 0x00};
 
-static uint8_t u8aRadiotapHeader80211n[] = {
+static const uint8_t u8aRadiotapHeader80211n[] = {
     0x00, 0x00,		    /**< @brief radiotap version */
     0x0d, 0x00,		    /**< @brief radiotap header length */
     0x00, 0x80, 0x08, 0x00, /**< @brief radiotap present flags (tx flags, mcs) */
@@ -119,7 +101,7 @@ static uint8_t u8aRadiotapHeader80211n[] = {
     0x00,		    /**< @brief mcs index 0 (speed level, will be overwritten later) */
 };
 
-static uint8_t u8aIeeeHeader_data[] = {
+static const uint8_t u8aIeeeHeader_data[] = {
     0x08, 0x02, 0x00, 0x00, /**< @brief frame control field (2 bytes), duration (2 bytes) */
     0xff, 0x00, 0x00, 0x00,
     0x00, 0x00, /**< @brief 1st byte of MAC will be overwritten with encoded port */
@@ -131,108 +113,118 @@ static uint8_t u8aIeeeHeader_data[] = {
 		   chip) */
 };
 
-static uint8_t u8aIeeeHeader_data_short[] = {
+static const uint8_t u8aIeeeHeader_data_short[] = {
     0x08, 0x01, 0x00, 0x00, /**< @brief frame control field (2 bytes), duration (2 bytes) */
     0xff		    /**< @brief 1st byte of MAC will be overwritten with encoded port */
 };
 
-static uint8_t u8aIeeeHeader_rts[] = {
+static const uint8_t u8aIeeeHeader_rts[] = {
     0xb4, 0x01, 0x00, 0x00, /**< @brief frame control field (2 bytes), duration (2 bytes) */
     0xff		    /**< @brief 1st byte of MAC will be overwritten with encoded port */
 };
 
-static uint8_t dummydata[] = {0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd,
-			      0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd};
+static const uint8_t dummydata[] = {0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd,
+				    0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd,
+				    0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd};
 
 int flagHelp = 0;
 
-static void
-wfb_write(wfb_tx_t *wfb_tx, uint32_t seqno, const uint8_t data[], uint16_t len, bool add_header)
+int
+wfb_tx_queue(wfb_tx_t *wfb_tx, uint32_t adapter, const struct iovec iov[], size_t iovcnt)
 {
-	size_t padlen = 0;
+	int result = -1;
+
+	size_t len = 0U;
 	size_t i;
-	size_t offset = 0U;
 
-	if (add_header) {
-		header.seqnumber = seqno;
-		header.length = len;
+	for (i = 0U; i < iovcnt; i++) {
+		len += iov[i].iov_len;
 	}
 
-	for (i = 0; i < wfb_tx->count; i++) {
-		switch (wfb_tx->type[i]) {
-		case 0:
-			/* type: Ralink */
-			if (add_header) {
-				/* header (seqno and len) */
-				memcpy(packet_buffer_ral + headers_ralink_len, &header, 6U);
-				offset = 6U;
-			}
-			memcpy(packet_buffer_ral + headers_ralink_len + offset, data, len);
+	if (len <= WFB_TX_FRAME_SIZE) {
+		wfb_tx_queued_t *queued = shm_ring_reserve(&wfb_tx->queue);
 
-			if (len < 18U) {
-				/* pad to minimum length */
-				padlen = 18U - len;
-				memcpy(packet_buffer_ral + headers_ralink_len + offset + len,
-				       dummydata, padlen);
-			}
+		if (queued != NULL) {
+			uint8_t *pos = (uint8_t *)&queued[1];
+
+			queued->ts = svc_get_monotime();
+			queued->adapter = adapter;
+			queued->reserved = 0U;
 
-			if (write(wfb_tx->sock[i], &packet_buffer_ral,
-				  headers_ralink_len + offset + len + padlen) < 0) {
-				log_err("Cannot write sock");
-				exit(1);
+			/* the only copy of the payload on the way to the injector */
+			for (i = 0U; i < iovcnt; i++) {
+				memcpy(pos, iov[i].iov_base, iov[i].iov_len);
+				pos += iov[i].iov_len;
 			}
 
-			break;
+			shm_ring_commit(&wfb_tx->queue, sizeof(wfb_tx_queued_t) + len);
+			shm_ring_notify(&wfb_tx->queue);
 
-		case 1:
-			/* type: atheros */
-			if (add_header) {
-				memcpy(packet_buffer_ath + headers_atheros_len, &header, 6U);
-				offset = 6U;
-			}
-			/* data */
-			memcpy(packet_buffer_ath + headers_atheros_len + offset, data, len);
-			if (len < 5U) {
-				padlen = 5U - len;
-				memcpy(packet_buffer_ath + headers_atheros_len + offset + len,
-				       dummydata, padlen);
-			}
+			result = 0;
+		}
+	}
 
-			if (write(wfb_tx->sock[i], &packet_buffer_ath,
-				  headers_atheros_len + offset + len + padlen) < 0) {
-				log_err("Cannot write sock");
-				exit(1);
-			}
+	return result;
+}
 
-			break;
+static int
+frame_write(wfb_tx_t *wfb_tx, size_t adapter, const struct iovec iov[], size_t iovcnt)
+{
+	int result = 0;
 
-		case 2:
-			/* type: Realtek */
-			if (add_header) {
-				memcpy(packet_buffer_rea + headers_Realtek_len, &header, 6U);
-				offset = 6U;
-			}
-			memcpy(packet_buffer_rea + headers_Realtek_len + offset, data, len);
-			if (len < 5U) {
-				/* if payload is too short, pad to minimum length */
-				padlen = 5U - len;
-				memcpy(packet_buffer_rea + headers_Realtek_len + offset + len,
-				       dummydata, padlen);
-			}
+	if (wfb_tx->backend == WFB_TX_BACKEND_QUEUE) {
+		/* a full queue is not fatal, the frame is dropped */
+		(void)wfb_tx_queue(wfb_tx, (uint32_t)adapter, iov, iovcnt);
+	} else if (writev(wfb_tx->sock[adapter], iov, (int)iovcnt) < 0) {
+		result = -1;
+	}
 
-			if (write(wfb_tx->sock[i], &packet_buffer_rea,
-				  headers_Realtek_len + offset + len + padlen) < 0) {
-				log_err("Cannot write sock");
-				exit(1);
-			}
+	return result;
+}
 
-			break;
+/*
+ * The frame is gathered from the headers of the adapter, the sequence header, the data in
+ * place and the constant padding, nothing is copied
+ */
+static void
+wfb_write(wfb_tx_t *wfb_tx, uint32_t seqno, const uint8_t data[], uint16_t len, bool add_header)
+{
+	struct header_s header;
+	struct iovec iov[4];
+	size_t i;
 
-		default:
-			log_err("Wrong or no frame type specified (see -t parameter)");
-			exit(1);
+	header.seqnumber = seqno;
+	header.length = len;
 
-			break;
+	for (i = 0; i < wfb_tx->count; i++) {
+		const wfb_tx_template_t *tmpl = &wfb_tx->tmpl[i];
+		size_t n = 0U;
+
+		iov[n].iov_base = (void *)tmpl->hdr;
+		iov[n].iov_len = tmpl->hdr_len;
+		n++;
+
+		if (add_header) {
+			/* header (seqno and len) */
+			iov[n].iov_base = &header;
+			iov[n].iov_len = sizeof(header);
+			n++;
+		}
+
+		iov[n].iov_base = (void *)data;
+		iov[n].iov_len = len;
+		n++;
+
+		if (len < tmpl->min_len) {
+			/* pad to minimum length */
+			iov[n].iov_base = (void *)dummydata;
+			iov[n].iov_len = tmpl->min_len - len;
+			n++;
+		}
+
+		if (frame_write(wfb_tx, i, iov, n) < 0) {
+			log_err("Cannot write sock");
+			exit(1);
 		}
 	}
 
@@ -255,6 +247,99 @@ wfb_tx_send_raw(wfb_tx_t *wfb_tx, const uint8_t data[], uint16_t len)
 	wfb_write(wfb_tx, 0U, data, len, false);
 }
 
+static uint8_t
+rate_byte(int rate)
+{
+	uint8_t result = 0U;
+
+	switch (rate) {
+	case 1:
+		result = 0x02;
+		break;
+	case 2:
+		result = 0x04;
+		break;
+	case 5: // 5.5
+		result = 0x0b;
+		break;
+	case 6:
+		result = 0x0c;
+		break;
+	case 11:
+		result = 0x16;
+		break;
+	case 12:
+		result = 0x18;
+		break;
+	case 18:
+		result = 0x24;
+		break;
+	case 24:
+		result = 0x30;
+		break;
+	case 36:
+		result = 0x48;
+		break;
+	case 48:
+		result = 0x60;
+		break;
+	default:
+		log_err("tx_telemetry: ERROR: Wrong or no data rate specified (see -d "
+			"parameter)");
+		exit(1);
+		break;
+	}
+
+	return result;
+}
+
+/*
+ * Lays out the radiotap and IEEE headers of the adapter type once, every frame of the
+ * adapter starts with them
+ */
+static void
+template_init(wfb_tx_template_t *tmpl, int type, int port, bool use_cts, uint8_t rate)
+{
+	const uint8_t *ieee;
+	size_t ieee_len;
+	size_t rt_len;
+
+	if (type == 2) {
+		// for Realtek use rts frames
+		memcpy(tmpl->hdr, u8aRadiotapHeader80211n, sizeof(u8aRadiotapHeader80211n));
+		rt_len = sizeof(u8aRadiotapHeader80211n);
+	} else {
+		memcpy(tmpl->hdr, u8aRadiotapHeader, sizeof(u8aRadiotapHeader));
+		tmpl->hdr[8] = rate;
+		rt_len = sizeof(u8aRadiotapHeader);
+	}
+
+	if (type == 0) {
+		// for Ralink always use data short
+		ieee = u8aIeeeHeader_data_short;
+		ieee_len = sizeof(u8aIeeeHeader_data_short);
+		tmpl->min_len = 18U;
+	} else if ((type == 1) && use_cts) {
+		// for Atheros use data frames if CTS protection enabled or rts if disabled
+		// CTS protection causes R/C transmission to stop for some reason, always use rts
+		// frames (i.e. no cts protection) use_cts = 0;
+		ieee = u8aIeeeHeader_data;
+		ieee_len = sizeof(u8aIeeeHeader_data);
+		tmpl->min_len = 5U;
+	} else {
+		ieee = u8aIeeeHeader_rts;
+		ieee_len = sizeof(u8aIeeeHeader_rts);
+		tmpl->min_len = 5U;
+	}
+
+	memcpy(tmpl->hdr + rt_len, ieee, ieee_len);
+
+	/* 1st byte of MAC is the encoded port */
+	tmpl->hdr[rt_len + 4U] = (uint8_t)((port * 2) + 1);
+
+	tmpl->hdr_len = rt_len + ieee_len;
+}
+
 int
 wfb_tx_init(wfb_tx_t *wfb_tx, int port, bool use_cts)
 {
@@ -271,14 +356,12 @@ wfb_tx_init(wfb_tx_t *wfb_tx, int port, bool use_cts)
 			break;
 		}
 
-		size_t num_interfaces = 0U;
 		size_t num_if = (size_t)res;
 
-		int port_encoded = 0;
 		int param_data_rate = 12;
 		size_t i;
 
-		for (i = 0; (i < num_if) && (num_interfaces < NL_MAX_IFACES); i++) {
+		for (i = 0; (i < num_if) && (wfb_tx->count < NL_MAX_IFACES); i++) {
 			FILE *procfile;
 			char line[100];
 			char path[128];
@@ -310,14 +393,21 @@ wfb_tx_init(wfb_tx_t *wfb_tx, int port, bool use_cts)
 			     strncmp(line, "DRIVER=rtl88xxau", 16) == 0)) {
 				if (strncmp(line, "DRIVER=ath9k_htc", 16) == 0) {
 					log_inf("tx_telemetry: Atheros card detected");
-					wfb_tx->type[num_interfaces] = 1;
+					wfb_tx->type[wfb_tx->count] = 1;
 				} else {
 					log_inf("tx_telemetry: Realtek card detected");
-					wfb_tx->type[num_interfaces] = 2;
+					wfb_tx->type[wfb_tx->count] = 2;
 				}
 			} else { // ralink or mediatek
 				log_inf("tx_telemetry: Ralink or other type card detected");
-				wfb_tx->type[num_interfaces] = 0;
+				wfb_tx->type[wfb_tx->count] = 0;
+			}
+
+			if (wfb_tx->backend == WFB_TX_BACKEND_QUEUE) {
+				/* the injector has the sockets */
+				wfb_tx->sock[wfb_tx->count] = -1;
+				wfb_tx->count++;
+				continue;
 			}
 
 			wfb_tx->sock[wfb_tx->count] = wfb_open_sock(&if_list[i]);
@@ -329,89 +419,24 @@ wfb_tx_init(wfb_tx_t *wfb_tx, int port, bool use_cts)
 			}
 		}
 
-		if (result != 0) {
-			return result;
-		}
+		if ((result == 0) && (wfb_tx->backend == WFB_TX_BACKEND_QUEUE)) {
+			char name[64];
 
-		switch (param_data_rate) {
-		case 1:
-			u8aRadiotapHeader[8] = 0x02;
-			break;
-		case 2:
-			u8aRadiotapHeader[8] = 0x04;
-			break;
-		case 5: // 5.5
-			u8aRadiotapHeader[8] = 0x0b;
-			break;
-		case 6:
-			u8aRadiotapHeader[8] = 0x0c;
-			break;
-		case 11:
-			u8aRadiotapHeader[8] = 0x16;
-			break;
-		case 12:
-			u8aRadiotapHeader[8] = 0x18;
-			break;
-		case 18:
-			u8aRadiotapHeader[8] = 0x24;
-			break;
-		case 24:
-			u8aRadiotapHeader[8] = 0x30;
-			break;
-		case 36:
-			u8aRadiotapHeader[8] = 0x48;
-			break;
-		case 48:
-			u8aRadiotapHeader[8] = 0x60;
-			break;
-		default:
-			log_err("tx_telemetry: ERROR: Wrong or no data rate specified (see -d "
-				"parameter)");
-			exit(1);
-			break;
+			snprintf(name, sizeof(name), WFB_TX_QUEUE, port);
+			if (!shm_ring_open(name, &wfb_tx->queue)) {
+				result = -1;
+			}
 		}
 
-		port_encoded = (port * 2) + 1;
-		u8aIeeeHeader_rts[4] = port_encoded;
-		u8aIeeeHeader_data[4] = port_encoded;
-		u8aIeeeHeader_data_short[4] = port_encoded;
-
-		// for Atheros use data frames if CTS protection enabled or rts if disabled
-		// CTS protection causes R/C transmission to stop for some reason, always use rts
-		// frames (i.e. no cts protection) use_cts = 0;
-		if (use_cts) { // use data frames
-			memcpy(headers_atheros, u8aRadiotapHeader,
-			       sizeof(u8aRadiotapHeader)); // radiotap header
-			memcpy(headers_atheros + sizeof(u8aRadiotapHeader), u8aIeeeHeader_data,
-			       sizeof(u8aIeeeHeader_data)); // ieee header
-			headers_atheros_len =
-			    sizeof(u8aRadiotapHeader) + sizeof(u8aIeeeHeader_data);
-		} else { // use rts frames
-			memcpy(headers_atheros, u8aRadiotapHeader,
-			       sizeof(u8aRadiotapHeader)); // radiotap header
-			memcpy(headers_atheros + sizeof(u8aRadiotapHeader), u8aIeeeHeader_rts,
-			       sizeof(u8aIeeeHeader_rts)); // ieee header
-			headers_atheros_len = sizeof(u8aRadiotapHeader) + sizeof(u8aIeeeHeader_rts);
+		if (result != 0) {
+			return result;
 		}
 
-		// for Ralink always use data short
-		memcpy(headers_ralink, u8aRadiotapHeader,
-		       sizeof(u8aRadiotapHeader)); // radiotap header
-		memcpy(headers_ralink + sizeof(u8aRadiotapHeader), u8aIeeeHeader_data_short,
-		       sizeof(u8aIeeeHeader_data_short)); // ieee header
-		headers_ralink_len = sizeof(u8aRadiotapHeader) + sizeof(u8aIeeeHeader_data_short);
+		uint8_t rate = rate_byte(param_data_rate);
 
-		// for Realtek use rts frames
-		memcpy(headers_Realtek, u8aRadiotapHeader80211n,
-		       sizeof(u8aRadiotapHeader80211n)); // radiotap header
-		memcpy(headers_Realtek + sizeof(u8aRadiotapHeader80211n), u8aIeeeHeader_rts,
-		       sizeof(u8aIeeeHeader_rts)); // ieee header
-		headers_Realtek_len = sizeof(u8aRadiotapHeader80211n) + sizeof(u8aIeeeHeader_rts);
-
-		// radiotap and ieee headers
-		memcpy(packet_buffer_ath, headers_atheros, headers_atheros_len);
-		memcpy(packet_buffer_ral, headers_ralink, headers_ralink_len);
-		memcpy(packet_buffer_rea, headers_Realtek, headers_Realtek_len);
+		for (i = 0U; i < wfb_tx->count; i++) {
+			template_init(&wfb_tx->tmpl[i], wfb_tx->type[i], port, use_cts, rate);
+		}
 	} while (false);
 
 	return result;
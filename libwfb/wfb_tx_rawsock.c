@@ -22,22 +22,24 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/if_packet.h>
+#include <linux/sockios.h>
 #include <net/if.h>
 #include <netinet/ether.h>
-#include <netpacket/packet.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 
 #include <log/log.h>
 #include <private/fec.h>
+#include <private/wfb_proto.h>
 #include <svc/svc.h>
+#include <wfb/wfb_inject.h>
 #include <wfb/wfb_tx_rawsock.h>
 
-#define MAX_USER_PACKET_LENGTH 2278
-#define MAX_DATA_OR_FEC_PACKETS_PER_BLOCK 32
-
 #define IEEE80211_RADIOTAP_MCS_HAVE_BW 0x01
 #define IEEE80211_RADIOTAP_MCS_HAVE_MCS 0x02
 #define IEEE80211_RADIOTAP_MCS_HAVE_GI 0x04
@@ -59,36 +61,11 @@
 #define IEEE80211_RADIOTAP_MCS_STBC_3 3
 #define IEEE80211_RADIOTAP_MCS_STBC_SHIFT 5
 
-static size_t param_data_packets_per_block = 8U;
-static size_t param_fec_packets_per_block = 4U;
-static size_t param_packet_length = 1024U;
-static size_t param_min_packet_length = 24U;
-static size_t param_measure = 0U;
-
-static int skipfec = 0;
-static int block_cnt = 0;
-
-static uint64_t took_last = 0ULL;
-static uint64_t took = 0ULL;
-
-static uint64_t injection_time_now = 0;
-static uint64_t injection_time_prev = 0;
-
-/*
- * This sits at the payload of the wifi packet (outside of FEC)
- *
- */
-typedef struct {
-	uint32_t sequence_number;
-} __attribute__((packed)) wifi_packet_header_t;
+/* the frame data follows the aligned header in a tx ring frame */
+#define TX_RING_ALIGN(x) (((x) + (TPACKET_ALIGNMENT - 1U)) & ~(size_t)(TPACKET_ALIGNMENT - 1U))
+#define TX_RING_DATA_OFFSET TX_RING_ALIGN(sizeof(struct tpacket2_hdr))
 
-/*
- * This sits at the data payload (which is usually right after the wifi_packet_header_t)
- * (inside of FEC)
- */
-typedef struct {
-	uint32_t data_length;
-} __attribute__((packed)) payload_header_t;
+static size_t param_min_packet_length = 24U;
 
 static u8 u8aRadiotapHeader80211N[] __attribute__((unused)) = {
     0x00, 0x00,		    // <-- radiotap version
@@ -165,7 +142,7 @@ alloc_packet_buffer_list(size_t num_packets, size_t packet_length)
 
 /*=========================================================*/
 
-static int
+int
 wfb_open_rawsock(const if_desc_t *iface)
 {
 	int sock;
@@ -190,6 +167,121 @@ wfb_open_rawsock(const if_desc_t *iface)
 	return sock;
 }
 
+/*
+ * Raw socket with a TPACKET_V2 transmit ring that skips the qdisc. The headers of the
+ * stream are written into every frame here, once
+ */
+static int
+open_tx_ring(const if_desc_t *iface, wfb_tx_ring_t *ring, const uint8_t phdr[],
+	     size_t phdr_len)
+{
+	int sock = wfb_open_rawsock(iface);
+
+	int version = TPACKET_V2;
+	if (setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		log_err("setsockopt PACKET_VERSION: %i", errno);
+		exit(1);
+	}
+
+	int bypass = 1;
+	if (setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass, sizeof(bypass)) < 0) {
+		/* older kernels: the ring works through the qdisc */
+		log_warn("setsockopt PACKET_QDISC_BYPASS: %i", errno);
+	}
+
+	size_t page_size = (size_t)getpagesize();
+	size_t block_size = WFB_TX_RING_FRAME_SIZE;
+	if (block_size < page_size) {
+		block_size = page_size;
+	}
+
+	size_t frames_per_block = block_size / WFB_TX_RING_FRAME_SIZE;
+
+	struct tpacket_req req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = (unsigned int)block_size;
+	req.tp_block_nr = (unsigned int)(WFB_TX_RING_FRAMES / frames_per_block);
+	req.tp_frame_size = WFB_TX_RING_FRAME_SIZE;
+	req.tp_frame_nr = WFB_TX_RING_FRAMES;
+
+	if (setsockopt(sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+		log_err("setsockopt PACKET_TX_RING: %i", errno);
+		exit(1);
+	}
+
+	ring->map = mmap(NULL, (size_t)req.tp_block_size * req.tp_block_nr,
+			 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, sock, 0);
+	if (ring->map == MAP_FAILED) {
+		log_err("mmap() tx ring error: %i", errno);
+		exit(1);
+	}
+
+	size_t i;
+	for (i = 0U; i < WFB_TX_RING_FRAMES; i++) {
+		uint8_t *frame = ring->map + (i * WFB_TX_RING_FRAME_SIZE);
+
+		memcpy(frame + TX_RING_DATA_OFFSET, phdr, phdr_len);
+	}
+
+	ring->next = 0U;
+	ring->queued = 0U;
+
+	return sock;
+}
+
+/*
+ * Hands the filled frames of every ring to the kernel, without waiting for them to go out
+ */
+static void
+tx_ring_kick(wfb_stream_t *stream)
+{
+	size_t i;
+
+	if (stream->wfb_tx.backend != WFB_TX_BACKEND_TX_RING) {
+		return;
+	}
+
+	for (i = 0U; i < stream->wfb_tx.count; i++) {
+		if (stream->tx_ring[i].queued == 0U) {
+			continue;
+		}
+
+		if ((send(stream->wfb_tx.sock[i], NULL, 0U, MSG_DONTWAIT) < 0) &&
+		    (errno != EAGAIN)) {
+			log_warn("tx ring send() failed: %i", errno);
+		}
+
+		stream->tx_ring[i].queued = 0U;
+	}
+}
+
+/*
+ * Next free frame of the ring. A full ring is kicked and waited for as long as the send
+ * timeout of a plain socket
+ */
+static struct tpacket2_hdr *
+tx_ring_frame(wfb_stream_t *stream, size_t adapter)
+{
+	wfb_tx_ring_t *ring = &stream->tx_ring[adapter];
+	struct tpacket2_hdr *hdr =
+	    (struct tpacket2_hdr *)(ring->map + (ring->next * WFB_TX_RING_FRAME_SIZE));
+
+	uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+	if ((status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) != 0U) {
+		tx_ring_kick(stream);
+
+		struct pollfd pfd = {.fd = stream->wfb_tx.sock[adapter], .events = POLLOUT};
+		(void)poll(&pfd, 1U, 8);
+
+		status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+		if ((status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) != 0U) {
+			hdr = NULL;
+		}
+	}
+
+	return hdr;
+}
+
 static size_t
 packet_header_init80211N(uint8_t *packet_header, int type, int port)
 {
@@ -379,168 +471,281 @@ packet_header_init(uint8_t *packet_header, int type, int rate, int port)
 }
 
 static int
-pb_transmit_packet(wfb_stream_t *stream, uint32_t seq_nr, const uint8_t *packet_data,
+pb_transmit_packet(wfb_stream_t *stream, size_t packet_num, const uint8_t *packet_data,
 		   size_t packet_length)
 {
 	/* Add header outside of FEC */
-	wifi_packet_header_t *wph = (wifi_packet_header_t *)(stream->buf + stream->phdr_len);
+	wifi_packet_header_t wph;
 
-	wph->sequence_number = seq_nr;
-
-	memcpy(stream->buf + stream->phdr_len + sizeof(wifi_packet_header_t), packet_data,
-	       packet_length);
+	wph.block_num = stream->input_buffer.block_num;
+	wph.packet_num = (uint8_t)packet_num;
+	wph.data_packets = (uint8_t)stream->fec.data_packets;
+	wph.fec_packets = (uint8_t)stream->fec.fec_packets;
+	wph.flags = 0U;
+	wph.packet_length = (uint16_t)stream->fec.packet_length;
 
 	size_t plen = packet_length + stream->phdr_len + sizeof(wifi_packet_header_t);
 
-	size_t i = 0;
-	for (i = 0; i < stream->wfb_tx.count; i++) {
-		if (write(stream->wfb_tx.sock[i], stream->buf, plen) < 0) {
-			log_warn("write failed: %i", errno);
-			return 1;
+	/* the stream headers, the packet header and the packet in place */
+	struct iovec iov[3] = {
+	    {.iov_base = stream->buf, .iov_len = stream->phdr_len},
+	    {.iov_base = &wph, .iov_len = sizeof(wph)},
+	    {.iov_base = (void *)packet_data, .iov_len = packet_length},
+	};
+
+	int result = 0;
+	uint64_t start = svc_get_monotime();
+
+	if (stream->wfb_tx.backend == WFB_TX_BACKEND_TX_RING) {
+		size_t i;
+
+		/* the headers are in the frame already, see open_tx_ring() */
+		for (i = 0U; i < stream->wfb_tx.count; i++) {
+			struct tpacket2_hdr *hdr = tx_ring_frame(stream, i);
+			if (hdr == NULL) {
+				result = 1;
+				continue;
+			}
+
+			uint8_t *frame = (uint8_t *)hdr + TX_RING_DATA_OFFSET + stream->phdr_len;
+			memcpy(frame, &wph, sizeof(wph));
+			memcpy(frame + sizeof(wph), packet_data, packet_length);
+			hdr->tp_len = (uint32_t)plen;
+			__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+			wfb_tx_ring_t *ring = &stream->tx_ring[i];
+			ring->next = (ring->next + 1U) % WFB_TX_RING_FRAMES;
+			ring->queued++;
+		}
+	} else if (stream->wfb_tx.backend == WFB_TX_BACKEND_QUEUE) {
+		/* the same frame for every adapter */
+		if (wfb_tx_queue(&stream->wfb_tx, WFB_TX_ADAPTER_ALL, iov, 3U) < 0) {
+			result = 1;
+		}
+	} else {
+		size_t i = 0;
+		for (i = 0; i < stream->wfb_tx.count; i++) {
+			/* one adapter failing does not keep the frame from the others */
+			if (writev(stream->wfb_tx.sock[i], iov, 3) < 0) {
+				result = 1;
+				continue;
+			}
 		}
 	}
 
-	return 0;
+	stream->input_buffer.inject_time += svc_get_monotime() - start;
+
+	return result;
 }
 
-static void
-pb_transmit_block(wfb_stream_t *stream, packet_buffer_t *pbl, uint32_t *seq_nr,
-		  size_t packet_length, size_t data_packets_per_block, size_t fec_packets_per_block)
+static size_t
+frame_length(const wfb_stream_t *stream, size_t packet_length)
 {
-	uint8_t *data_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
-	uint8_t fec_pool[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK][MAX_USER_PACKET_LENGTH];
-	uint8_t *fec_blocks[MAX_DATA_OR_FEC_PACKETS_PER_BLOCK];
+	return stream->phdr_len + sizeof(wifi_packet_header_t) + packet_length;
+}
 
+/*
+ * Frames waiting to go out: in the injector queue and the injector socket send queues, or
+ * the deepest of the socket send queues with the tx ring frames not kicked yet
+ */
+static size_t
+stream_backlog(wfb_stream_t *stream)
+{
+	size_t result = 0U;
+	size_t frame_len = frame_length(stream, stream->fec.packet_length);
 	size_t i;
-	for (i = 0; i < data_packets_per_block; ++i) {
-		data_blocks[i] = pbl[i].data;
-	}
 
-	/*
-	 * This allows the number of FEC packets to be set to zero
-	 *
-	 * In that case the FEC process will not be run at all, and only data blocks will be
-	 * transmitted
-	 */
-	if (fec_packets_per_block) {
-		for (i = 0; i < fec_packets_per_block; ++i) {
-			fec_blocks[i] = fec_pool[i];
-		}
-		fec_encode(packet_length, data_blocks, data_packets_per_block,
-			   (unsigned char **)fec_blocks, fec_packets_per_block);
-	}
+	if (stream->wfb_tx.backend == WFB_TX_BACKEND_QUEUE) {
+		wfb_inject_outq_t outq;
 
-	uint8_t *pb = stream->buf;
-	pb += stream->phdr_len;
+		result = shm_ring_count(&stream->wfb_tx.queue);
+		if (shm_map_fetch(&stream->outq_shm, &outq, sizeof(outq), NULL) == 0) {
+			result += outq.bytes / frame_len;
+		}
+	} else {
 
-	size_t di = 0U;
-	size_t fi = 0U;
-	size_t seq_nr_tmp = *seq_nr;
-	int counterfec = 0;
+		for (i = 0U; i < stream->wfb_tx.count; i++) {
+			int outq = 0;
+			size_t backlog = 0U;
 
-	uint64_t prev_time = svc_get_monotime();
+			if (ioctl(stream->wfb_tx.sock[i], SIOCOUTQ, &outq) == 0) {
+				backlog = (size_t)outq / frame_len;
+			}
 
-	/*
-	 * Send data and FEC packets interleaved
-	 */
-	while ((di < data_packets_per_block) || (fi < fec_packets_per_block)) {
-		if (di < data_packets_per_block) {
-			if (pb_transmit_packet(stream, seq_nr_tmp, data_blocks[di],
-					       packet_length)) {
-				log_warn("packet send failed");
+			if (stream->wfb_tx.backend == WFB_TX_BACKEND_TX_RING) {
+				backlog += stream->tx_ring[i].queued;
 			}
 
-			seq_nr_tmp++;
-			di++;
+			if (backlog > result) {
+				result = backlog;
+			}
 		}
+	}
 
-		if (fi < fec_packets_per_block) {
-			if (skipfec < 1) {
-				if (pb_transmit_packet(stream, seq_nr_tmp, fec_blocks[fi],
-						       packet_length)) {
-					// td1->tx_status->injection_fail_cnt++;
-					log_warn("packet send failed");
-				}
-			} else {
-				if (counterfec % 2 == 0) {
-					if (pb_transmit_packet(stream, seq_nr_tmp, fec_blocks[fi],
-							       packet_length)) {
-						// td1->tx_status->injection_fail_cnt++;
-						log_warn("packet send failed");
-					}
-				} else {
-					// fprintf(stderr, "not transmitted\n");
-				}
+	return result;
+}
 
-				counterfec++;
-			}
+static void
+pacer_refill(wfb_tx_pacer_t *pacer, uint64_t now)
+{
+	if (pacer->cfg.rate_kbit == 0U) {
+		return;
+	}
 
-			seq_nr_tmp++;
-			fi++;
-		}
+	/* kbit/s is 1 byte per 8000000 / rate ns */
+	uint64_t bytes = ((now - pacer->last) * pacer->cfg.rate_kbit) / 8000000ULL;
+	if (bytes == 0ULL) {
+		return;
+	}
+
+	pacer->last = now;
+	pacer->tokens += (int64_t)bytes;
+	if (pacer->tokens > (int64_t)pacer->cfg.burst) {
+		pacer->tokens = (int64_t)pacer->cfg.burst;
+	}
+}
+
+/*
+ * A block that starts with the link far behind is not sent at all, the packets it would
+ * add only make the next blocks late as well
+ */
+static bool
+pacer_block_late(wfb_stream_t *stream)
+{
+	wfb_tx_pacer_t *pacer = &stream->pacer;
+
+	pacer_refill(pacer, svc_get_monotime());
+
+	bool result = (stream_backlog(stream) > pacer->cfg.backlog_late);
+
+	if ((pacer->cfg.rate_kbit > 0U) && (pacer->tokens < -(int64_t)pacer->cfg.burst)) {
+		result = true;
+	}
+
+	return result;
+}
+
+/*
+ * Parity goes out only with the link keeping up, it is the first thing to shed
+ */
+static bool
+pacer_fec_allowed(wfb_stream_t *stream, size_t len)
+{
+	wfb_tx_pacer_t *pacer = &stream->pacer;
+
+	pacer_refill(pacer, svc_get_monotime());
+
+	bool result = (stream_backlog(stream) <= pacer->cfg.backlog_fec);
+
+	if ((pacer->cfg.rate_kbit > 0U) && (pacer->tokens < (int64_t)len)) {
+		result = false;
+	}
+
+	return result;
+}
+
+/*
+ * Data packets are sent as soon as they are complete, their share of the parity
+ * is added at the same time. Nothing is left for the end of the block but the
+ * FEC packets themselves.
+ *
+ * Packets go out at their real length. The parity covers the longest packet of
+ * the block, shorter ones count as zero-extended.
+ */
+static void
+pb_transmit_data(wfb_stream_t *stream, const packet_buffer_t *pb, size_t packet_num)
+{
+	input_buffer_t *input = &stream->input_buffer;
+	size_t i;
+
+	if (packet_num == 0U) {
+		input->inject_time = 0ULL;
+		input->fec_len = 0U;
+		input->late = pacer_block_late(stream);
+	}
 
-		skipfec--;
+	if (input->late) {
+		return;
 	}
 
 	/*
-	 * We don't do any of this during a bandwidth measurement, because it would affect the
-	 * measurement and cause the air side to believe there is more bandwidth available than
-	 * there really is.
+	 * This allows the number of FEC packets to be set to zero
 	 *
-	 * Before this check was added, RTL8812au cards were measuring upwards of 40Mbit available
-	 * bandwidth, which is clearly wrong when the hardware data rate is only 18Mbit.
+	 * In that case the FEC process will not be run at all, and only data blocks will be
+	 * transmitted
 	 */
-	if (param_measure == 0) {
-		block_cnt++;
+	if (stream->fec.fec_packets > 0U) {
+		if (pb->len > input->fec_len) {
+			/* the zero tail of the shorter packets so far */
+			for (i = 0U; i < stream->fec.fec_packets; i++) {
+				memset(input->fec_blocks[i] + input->fec_len, 0,
+				       pb->len - input->fec_len);
+			}
 
-		// td1->tx_status->injected_block_cnt++;
+			input->fec_len = pb->len;
+		}
 
-		took_last = took;
-		took = svc_get_monotime() - prev_time;
+		fec_encode_add((unsigned int)pb->len, pb->data, (unsigned int)packet_num,
+			       input->fec_blocks, (unsigned int)stream->fec.fec_packets);
+	}
 
-		// if (took > 50) fprintf(stderr, "write took %lldus\n", took);
+	/* counted only, a full queue would flood the log with a line per packet */
+	if (pb_transmit_packet(stream, packet_num, pb->data, pb->len)) {
+		stream->tx_status.injection_fail_cnt++;
+	}
 
-		if (took >
-		    (packet_length * (data_packets_per_block + fec_packets_per_block)) / 1.5) {
-			/*
-			 * We simply assume 1us per byte = 1ms per 1024 byte packet (not very exact
-			 * ...)
-			 */
-			skipfec = 4;
-			// td1->tx_status->skipped_fec_cnt = td1->tx_status->skipped_fec_cnt +
-			// skipfec;
+	/* data packets may go over the rate, the next block pays for it */
+	stream->pacer.tokens -= (int64_t)frame_length(stream, pb->len);
+}
 
-			// fprintf(stderr, "\nwrite took %lldus skipping FEC packets ...\n", took);
-		}
+static void
+pb_transmit_fec(wfb_stream_t *stream, packet_buffer_t *pbl)
+{
+	input_buffer_t *input = &stream->input_buffer;
 
-		if (block_cnt % 50 == 0 && param_measure == 0) {
-			/*fprintf(stderr,
-				"\t\t%d blocks sent, injection time per block %lldus, %d fecs "
-				"skipped, %d packet injections failed.          \r",
-				block_cnt, td1->tx_status->injection_time_block,
-				td1->tx_status->skipped_fec_cnt,
-				td1->tx_status->injection_fail_cnt);
-			fflush(stderr);*/
-		}
+	const size_t data_packets_per_block = stream->fec.data_packets;
+	const size_t fec_packets_per_block = stream->fec.fec_packets;
 
-		if (took < took_last) {
-			/*
-			 * If we have a lower injection_time than last time, ignore
-			 */
-			took = took_last;
-		}
+	size_t i;
+
+	wifibroadcast_tx_status_t *tx_status = &stream->tx_status;
+
+	if (input->late) {
+		tx_status->late_block_cnt++;
+	} else {
+		/*
+		 * FEC packets follow the data packets of the block. The FEC count is set by the
+		 * stream owner (see wfb_stream_set_fec()), the pacer sheds the rest when the link
+		 * falls behind
+		 */
+		for (i = 0U; i < fec_packets_per_block; i++) {
+			size_t len = frame_length(stream, input->fec_len);
+
+			if (!pacer_fec_allowed(stream, len)) {
+				uint32_t shed = (uint32_t)(fec_packets_per_block - i);
 
-		injection_time_now = svc_get_monotime();
+				tx_status->skipped_fec_cnt += shed;
+				if (shed > stream->pacer.shed_max) {
+					stream->pacer.shed_max = shed;
+				}
+				break;
+			}
+
+			if (pb_transmit_packet(stream, data_packets_per_block + i,
+					       input->fec_blocks[i], input->fec_len)) {
+				tx_status->injection_fail_cnt++;
+			}
 
-		if (injection_time_now - injection_time_prev > 220) {
-			injection_time_prev = svc_get_monotime();
-			// td1->tx_status->injection_time_block = took;
-			took = 0;
-			took_last = 0;
+			stream->pacer.tokens -= (int64_t)len;
 		}
+
+		tx_status->injected_block_cnt++;
+		tx_status->injection_time_block = input->inject_time;
 	}
 
-	*seq_nr += data_packets_per_block + fec_packets_per_block;
+	tx_status->last_update = svc_get_monotime();
+
+	stream->input_buffer.block_num++;
 
 	/*
 	 * Reset the length for the next packet
@@ -551,10 +756,17 @@ pb_transmit_block(wfb_stream_t *stream, packet_buffer_t *pbl, uint32_t *seq_nr,
 }
 
 int
-wfb_stream_init(wfb_stream_t *stream, int port, int packet_type, bool useMCS, bool useSTBC,
-		bool useLDPC)
+wfb_stream_init(wfb_stream_t *stream, wfb_tx_backend_t backend, int port, int packet_type,
+		const wfb_fec_profile_t *fec, bool useMCS, bool useSTBC, bool useLDPC)
 {
 	memset(stream, 0, sizeof(wfb_stream_t));
+	stream->wfb_tx.backend = backend;
+
+	if (!wfb_fec_profile_valid(fec)) {
+		log_err("invalid FEC profile %zu/%zu/%zu", fec->data_packets, fec->fec_packets,
+			fec->packet_length);
+		return -1;
+	}
 
 	if_desc_t if_list[NL_MAX_IFACES];
 	int res;
@@ -600,17 +812,24 @@ wfb_stream_init(wfb_stream_t *stream, int port, int packet_type, bool useMCS, bo
 		    packet_header_init(stream->buf, packet_type, param_data_rate, port);
 	}
 
-	stream->input_buffer.seq_nr = 0;
+	stream->input_buffer.block_num = 0U;
 	stream->input_buffer.curr_pb = 0;
 	stream->input_buffer.pbl =
-	    alloc_packet_buffer_list(param_data_packets_per_block, MAX_PACKET_LENGTH);
+	    alloc_packet_buffer_list(WFB_FEC_MAX_PACKETS, MAX_PACKET_LENGTH);
+
+	for (i = 0; i < WFB_FEC_MAX_PACKETS; ++i) {
+		stream->input_buffer.fec_blocks[i] = malloc(WFB_FEC_MAX_PACKET_LENGTH);
+	}
 
 	stream->port = port;
+	stream->fec = *fec;
+	stream->fec_next = *fec;
+	stream->pacer.cfg = (wfb_tx_pacer_cfg_t)WFB_TX_PACER_CFG_DEFAULT;
 
 	/*
 	 * Prepare the buffers with headers
 	 */
-	for (i = 0; i < param_data_packets_per_block; ++i) {
+	for (i = 0; i < WFB_FEC_MAX_PACKETS; ++i) {
 		stream->input_buffer.pbl[i].len = 0;
 	}
 
@@ -622,38 +841,169 @@ wfb_stream_init(wfb_stream_t *stream, int port, int packet_type, bool useMCS, bo
 	/*telemetry_data_t td;
 	telemetry_init(&td);*/
 
-	for (i = 0; (i < num_if) && (num_interfaces < NL_MAX_IFACES); i++) {
-		stream->wfb_tx.sock[stream->wfb_tx.count] = wfb_open_rawsock(&if_list[i]);
-		stream->wfb_tx.count++;
+	if (backend == WFB_TX_BACKEND_QUEUE) {
+		char name[64];
 
-		/*
-		 * Wait a bit between configuring interfaces to reduce Atheros and Pi USB flakiness
-		 */
-		usleep(20000);
+		/* the injector has the sockets */
+		snprintf(name, sizeof(name), WFB_TX_QUEUE, port);
+		if (!shm_ring_open(name, &stream->wfb_tx.queue)) {
+			return -1;
+		}
+
+		if (!shm_map_open(WFB_INJECT_OUTQ, &stream->outq_shm)) {
+			return -1;
+		}
+
+		stream->wfb_tx.count = num_if;
+	} else {
+		for (i = 0; (i < num_if) && (num_interfaces < NL_MAX_IFACES); i++) {
+			size_t a = stream->wfb_tx.count;
+
+			if (backend == WFB_TX_BACKEND_TX_RING) {
+				stream->wfb_tx.sock[a] =
+				    open_tx_ring(&if_list[i], &stream->tx_ring[a], stream->buf,
+						 stream->phdr_len);
+			} else {
+				stream->wfb_tx.sock[a] = wfb_open_rawsock(&if_list[i]);
+			}
+			stream->wfb_tx.count++;
+
+			/*
+			 * Wait a bit between configuring interfaces to reduce Atheros and Pi USB
+			 * flakiness
+			 */
+			usleep(20000);
+		}
 	}
 
 	return 0;
 }
 
+int
+wfb_stream_set_fec(wfb_stream_t *wfb_stream, const wfb_fec_profile_t *fec)
+{
+	if (!wfb_fec_profile_valid(fec)) {
+		log_err("invalid FEC profile %zu/%zu/%zu", fec->data_packets, fec->fec_packets,
+			fec->packet_length);
+		return -1;
+	}
+
+	/* applied at the next block boundary */
+	wfb_stream->fec_next = *fec;
+
+	return 0;
+}
+
+/*
+ * Closes the packet being filled and sends it, the block is finished with its FEC packets
+ * after the last data packet
+ */
+static void
+pb_finish(wfb_stream_t *wfb_stream)
+{
+	input_buffer_t *input = &wfb_stream->input_buffer;
+	packet_buffer_t *pb = input->pbl + input->curr_pb;
+	payload_header_t *ph = (payload_header_t *)pb->data;
+
+	/*
+	 * Write the length into the packet. This is needed because with FEC, we cannot use the
+	 * wifi packet length anymore.
+	 */
+	ph->data_length = pb->len - sizeof(payload_header_t);
+	wfb_stream->wfb_tx.pcnt++;
+
+	pb_transmit_data(wfb_stream, pb, input->curr_pb);
+
+	/*
+	 * Check if this block is finished
+	 */
+	if (input->curr_pb == wfb_stream->fec.data_packets - 1U) {
+		pb_transmit_fec(wfb_stream, input->pbl);
+		input->curr_pb = 0;
+	} else {
+		input->curr_pb++;
+	}
+}
+
+int
+wfb_stream_set_coalesce(wfb_stream_t *wfb_stream, uint64_t coalesce)
+{
+	wfb_stream->coalesce = coalesce;
+
+	return 0;
+}
+
+int
+wfb_stream_set_pacer(wfb_stream_t *wfb_stream, const wfb_tx_pacer_cfg_t *cfg)
+{
+	wfb_stream->pacer.cfg = *cfg;
+	wfb_stream->pacer.tokens = (int64_t)cfg->burst;
+	wfb_stream->pacer.last = svc_get_monotime();
+
+	return 0;
+}
+
+uint32_t
+wfb_stream_shed(wfb_stream_t *wfb_stream)
+{
+	uint32_t result = wfb_stream->pacer.shed_max;
+
+	wfb_stream->pacer.shed_max = 0U;
+
+	return result;
+}
+
+uint64_t
+wfb_stream_deadline(const wfb_stream_t *wfb_stream)
+{
+	const input_buffer_t *input = &wfb_stream->input_buffer;
+	uint64_t deadline = 0ULL;
+
+	if (input->pbl[input->curr_pb].len > sizeof(payload_header_t)) {
+		deadline = input->first_ts + wfb_stream->coalesce;
+	}
+
+	return deadline;
+}
+
+void
+wfb_stream_flush(wfb_stream_t *wfb_stream)
+{
+	const input_buffer_t *input = &wfb_stream->input_buffer;
+
+	if (input->pbl[input->curr_pb].len > sizeof(payload_header_t)) {
+		pb_finish(wfb_stream);
+	}
+
+	tx_ring_kick(wfb_stream);
+}
+
 void
 wfb_tx_stream(wfb_stream_t *wfb_stream, uint8_t data[], uint16_t len)
 {
 	uint16_t offset = 0U;
 
 	do {
-		packet_buffer_t *pb =
-		    wfb_stream->input_buffer.pbl + wfb_stream->input_buffer.curr_pb;
+		input_buffer_t *input = &wfb_stream->input_buffer;
+		packet_buffer_t *pb = input->pbl + input->curr_pb;
 
 		/* If the buffer is fresh we add a payload header */
 		if (pb->len == 0) {
+			if (input->curr_pb == 0U) {
+				/* a new block: switch the profile if requested */
+				wfb_stream->fec = wfb_stream->fec_next;
+			}
+
 			/* Make space for a length field (will be filled later) */
 			pb->len += sizeof(payload_header_t);
+			input->first_ts = svc_get_monotime();
 		}
 
 		/* распределяем данные по пакетам */
+		const size_t packet_length = wfb_stream->fec.packet_length;
 		size_t copy_len = (size_t)(len - offset);
-		if (copy_len > (param_packet_length - pb->len)) {
-			copy_len = param_packet_length - pb->len;
+		if (copy_len > (packet_length - pb->len)) {
+			copy_len = packet_length - pb->len;
 		}
 		memcpy(&pb->data[pb->len], &data[offset], copy_len);
 		offset += copy_len;
@@ -661,34 +1011,16 @@ wfb_tx_stream(wfb_stream_t *wfb_stream, uint8_t data[], uint16_t len)
 		pb->len += copy_len;
 
 		/*
-		 * Check if this packet is finished
+		 * Check if this packet is finished. Without coalescing every piece of data goes
+		 * out at once, otherwise the packet is filled up to the full length and the
+		 * rest is sent by the deadline (see wfb_stream_flush())
 		 */
-		if (pb->len >= param_min_packet_length) {
-			payload_header_t *ph = (payload_header_t *)pb->data;
-			input_buffer_t *input = &wfb_stream->input_buffer;
-
-			/*
-			 * Write the length into the packet. This is needed because with FEC, we
-			 * cannot use the wifi packet length anymore.
-			 *
-			 * We could also set the user payload to a fixed size but this would
-			 * introduce additional latency since TX would need to wait until that
-			 * amount of data has been received.
-			 */
-			ph->data_length = pb->len - sizeof(payload_header_t);
-			wfb_stream->wfb_tx.pcnt++;
-
-			/*
-			 * Check if this block is finished
-			 */
-			if (wfb_stream->input_buffer.curr_pb == param_data_packets_per_block - 1) {
-				pb_transmit_block(wfb_stream, input->pbl, &(input->seq_nr),
-						  param_packet_length, param_data_packets_per_block,
-						  param_fec_packets_per_block);
-				input->curr_pb = 0;
-			} else {
-				input->curr_pb++;
-			}
+		if ((pb->len >= packet_length) ||
+		    ((wfb_stream->coalesce == 0ULL) && (pb->len >= param_min_packet_length))) {
+			pb_finish(wfb_stream);
 		}
 	} while (offset < len);
+
+	/* one kick for all the packets of the data, the FEC packets of a block included */
+	tx_ring_kick(wfb_stream);
 }
@@ -12,11 +12,51 @@
 
 #include <log/log.h>
 #include <svc/platform.h>
+#include <svc/sharedmem.h>
 #include <svc/svc.h>
+#include <wfb/wfb_fec_ctl.h>
 #include <wfb/wfb_tx_rawsock.h>
 
 #include <private/camera.h>
 
+/*
+ * Parity count follows the ground loss feedback, ground learns the profile from
+ * the stream itself
+ */
+static const wfb_fec_ctl_cfg_t video_fec_cfg = {
+    .profile = WFB_FEC_PROFILE_DEFAULT,
+    .fec_min = 1U,
+    .fec_max = 8U,
+    .airtime_budget = 50U,
+    .hold_time = 2ULL * TIME_S,
+    .timeout = 1ULL * TIME_S,
+};
+
+/*
+ * Video data is collected into full packets, but none waits longer than this
+ */
+static const uint64_t video_coalesce = 2ULL * TIME_MS;
+
+/*
+ * Video goes through the injector with the rest. WFB_TX_BACKEND_TX_RING writes the adapters
+ * right from the camera service, past the injector and the qdisc
+ */
+static const wfb_tx_backend_t video_backend = WFB_TX_BACKEND_QUEUE;
+
+/*
+ * Video may take most of the 12 Mbit/s air data rate, the rest is for telemetry and
+ * retransmissions. Parity is shed above a block and a half of backlog in the injector queue
+ */
+static const wfb_tx_pacer_cfg_t video_pacer = {
+    .rate_kbit = 9000U,
+    .burst = 32768U,
+    .backlog_fec = 24U,
+    .backlog_late = 128U,
+};
+
+static shm_t feedback_shm;
+static shm_t video_tx_status_shm;
+
 typedef struct {
 	int stdout_fds[2];
 	int stdin_fds[2];
@@ -144,6 +184,31 @@ camera_start(camera_desc_t *cam_desc)
 	return result;
 }
 
+static void
+fec_ctl_cycle(wfb_fec_ctl_t *ctl, wfb_stream_t *wfb_stream, uint64_t *last_update)
+{
+	wfb_fec_feedback_status_t status;
+	uint64_t now = svc_get_monotime();
+	bool changed = false;
+
+	if (shm_map_fetch(&feedback_shm, &status, sizeof(status), NULL) == 0) {
+		if (status.last_update != *last_update) {
+			*last_update = status.last_update;
+			changed = wfb_fec_ctl_feedback(ctl, &status.feedback,
+						       wfb_stream->tx_status.injected_block_cnt,
+						       wfb_stream_shed(wfb_stream), now);
+		}
+	}
+
+	if (wfb_fec_ctl_check(ctl, now)) {
+		changed = true;
+	}
+
+	if (changed) {
+		wfb_stream_set_fec(wfb_stream, &ctl->profile);
+	}
+}
+
 static int
 camera_cycle(camera_desc_t *cd, wfb_stream_t *wfb_stream)
 {
@@ -156,10 +221,17 @@ camera_cycle(camera_desc_t *cd, wfb_stream_t *wfb_stream)
 			break;
 		}
 
+		/* 1s timeout, or up to the deadline of the packet being filled */
+		uint64_t timeout = 1ULL * TIME_S;
+		uint64_t deadline = wfb_stream_deadline(wfb_stream);
+		if (deadline != 0ULL) {
+			uint64_t now = svc_get_monotime();
+			timeout = (deadline > now) ? (deadline - now) : 0ULL;
+		}
+
 		struct timeval to;
-		/* 1s timeout */
-		to.tv_sec = 1;
-		to.tv_usec = 0;
+		to.tv_sec = (time_t)(timeout / TIME_S);
+		to.tv_usec = (suseconds_t)((timeout % TIME_S) / TIME_US);
 		fd_set readset;
 		FD_ZERO(&readset);
 
@@ -171,7 +243,7 @@ camera_cycle(camera_desc_t *cd, wfb_stream_t *wfb_stream)
 		}
 
 		int n;
-		n = select(nfds, &readset, NULL, NULL, &to);
+		n = select(nfds + 1, &readset, NULL, NULL, &to);
 
 		if (n < 0) {
 			log_err("select() error");
@@ -212,15 +284,25 @@ camera_cycle(camera_desc_t *cd, wfb_stream_t *wfb_stream)
 		}
 	} while (false);
 
+	uint64_t deadline = wfb_stream_deadline(wfb_stream);
+	if ((deadline != 0ULL) && (svc_get_monotime() >= deadline)) {
+		wfb_stream_flush(wfb_stream);
+	}
+
 	return result;
 }
 
 int
 camera_init(void)
 {
-	/* do nothing */
+	int result = 0;
+
+	/* block counters of the video stream, see wfb_stream_t */
+	if (!shm_map_init("shm_video_tx_status", sizeof(wifibroadcast_tx_status_t))) {
+		result = -1;
+	}
 
-	return 0;
+	return result;
 }
 
 int
@@ -229,12 +311,33 @@ camera_main(void)
 	int result = 0;
 
 	do {
+		if (!shm_map_open("shm_fec_feedback", &feedback_shm)) {
+			log_err("cannot open shm_fec_feedback");
+			result = -1;
+			break;
+		}
+
+		if (!shm_map_open("shm_video_tx_status", &video_tx_status_shm)) {
+			log_err("cannot open shm_video_tx_status");
+			result = -1;
+			break;
+		}
+
+		wfb_fec_ctl_t fec_ctl;
+		uint64_t feedback_update = 0ULL;
+		uint64_t tx_status_update = 0ULL;
+		wfb_fec_ctl_init(&fec_ctl, &video_fec_cfg, svc_get_monotime());
+
 		wfb_stream_t wfb_stream;
-		result = wfb_stream_init(&wfb_stream, 0, 1, false, false, false);
+		result = wfb_stream_init(&wfb_stream, video_backend, 0, 1, &fec_ctl.profile, false,
+					 false, false);
 		if (result < 0) {
 			break;
 		}
 
+		wfb_stream_set_coalesce(&wfb_stream, video_coalesce);
+		wfb_stream_set_pacer(&wfb_stream, &video_pacer);
+
 		camera_desc_t cd;
 
 		result = camera_start(&cd);
@@ -246,6 +349,14 @@ camera_main(void)
 			if (camera_cycle(&cd, &wfb_stream) < 0) {
 				break;
 			}
+
+			fec_ctl_cycle(&fec_ctl, &wfb_stream, &feedback_update);
+
+			if (wfb_stream.tx_status.last_update != tx_status_update) {
+				tx_status_update = wfb_stream.tx_status.last_update;
+				shm_map_write(&video_tx_status_shm, &wfb_stream.tx_status,
+					      sizeof(wifibroadcast_tx_status_t));
+			}
 		}
 
 		kill(cd.pid, SIGKILL);
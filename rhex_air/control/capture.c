@@ -0,0 +1,46 @@
+/**
+ * @file capture.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Прием с адаптеров для всех сервисов бортовой части
+ */
+
+#include <svc/svc.h>
+#include <wfb/wfb_capture.h>
+#include <wfb/wfb_fec_ctl.h>
+
+#include <private/capture.h>
+
+/*
+ * Every adapter is opened here once, the services read their ports from the rings
+ */
+static const wfb_capture_port_t capture_ports[] = {
+    {.port = 30, .slots = 64U},			   /* rc */
+    {.port = WFB_FEC_FEEDBACK_PORT, .slots = 64U}, /* fec feedback */
+};
+
+#define CAPTURE_PORTS (sizeof(capture_ports) / sizeof(capture_ports[0]))
+
+int
+capture_init(void)
+{
+	return wfb_capture_init(capture_ports, CAPTURE_PORTS);
+}
+
+int
+capture_main(void)
+{
+	static wfb_capture_t cap;
+
+	int result = wfb_capture_open(&cap, capture_ports, CAPTURE_PORTS,
+				      WFB_RX_BACKEND_TPACKET_V3);
+
+	while ((result == 0) && svc_cycle()) {
+		if (wfb_capture(&cap) < 0) {
+			result = -1;
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file fec_feedback.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Прием статистики потерь видеопотока с наземной станции
+ */
+
+#include <string.h>
+
+#include <log/log.h>
+#include <svc/sharedmem.h>
+#include <svc/svc.h>
+#include <wfb/wfb_fec_ctl.h>
+#include <wfb/wfb_rx.h>
+
+#include <private/fec_feedback.h>
+
+static shm_t feedback_shm;
+
+int
+fec_feedback_init(void)
+{
+	shm_map_init("shm_fec_feedback", sizeof(wfb_fec_feedback_status_t));
+
+	return 0;
+}
+
+int
+fec_feedback_main(void)
+{
+	int result = 0;
+
+	do {
+		if (!shm_map_open("shm_fec_feedback", &feedback_shm)) {
+			log_err("cannot open shm_fec_feedback");
+			result = 1;
+			break;
+		}
+
+		wfb_rx_t feedback_rx = {
+		    .backend = WFB_RX_BACKEND_SHARED,
+		};
+
+		result = wfb_rx_init(&feedback_rx, WFB_FEC_FEEDBACK_PORT);
+		if (result != 0) {
+			break;
+		}
+
+		wfb_fec_feedback_status_t status;
+		memset(&status, 0, sizeof(status));
+
+		while (svc_cycle()) {
+			wfb_rx_packet_t rx_data = {
+			    0,
+			};
+
+			if (wfb_rx_packet(&feedback_rx, &rx_data) <= 0) {
+				continue;
+			}
+
+			if (rx_data.bytes < (int)sizeof(wfb_fec_feedback_t)) {
+				continue;
+			}
+
+			memcpy(&status.feedback, rx_data.data, sizeof(wfb_fec_feedback_t));
+			status.last_update = svc_get_monotime();
+
+			shm_map_write(&feedback_shm, &status, sizeof(status));
+		}
+	} while (false);
+
+	return result;
+}
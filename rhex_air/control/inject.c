@@ -0,0 +1,103 @@
+/**
+ * @file inject.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Отправка через адаптеры для всех сервисов бортовой части
+ */
+
+#include <log/log.h>
+#include <svc/sharedmem.h>
+#include <svc/svc.h>
+#include <wfb/wfb_inject.h>
+#include <wfb/wfb_status.h>
+
+#include <private/inject.h>
+
+/*
+ * Every adapter is written from here only, the services queue their frames by port. The
+ * ports are in order of priority
+ */
+static const wfb_inject_port_t inject_ports[] = {
+    {.port = 1, .slots = 64U},		    /* telemetry */
+    {.port = 63, .slots = 64U},		    /* rssi */
+    {.port = 0, .slots = 512U, .batch = 2U}, /* video */
+};
+
+#define INJECT_PORTS (sizeof(inject_ports) / sizeof(inject_ports[0]))
+
+static shm_t tx_status_shm;
+static shm_t video_tx_status_shm;
+
+/*
+ * The block counters come from the video stream, the injection counters from the injector
+ */
+static void
+publish_tx_status(const wfb_inject_t *inj)
+{
+	wifibroadcast_tx_status_t tx_status = inj->status.tx;
+	wifibroadcast_tx_status_t video;
+
+	if (shm_map_fetch(&video_tx_status_shm, &video, sizeof(video), NULL) == 0) {
+		tx_status.injected_block_cnt = video.injected_block_cnt;
+		tx_status.skipped_fec_cnt = video.skipped_fec_cnt;
+		tx_status.late_block_cnt = video.late_block_cnt;
+		tx_status.injection_time_block = video.injection_time_block;
+	}
+
+	shm_map_write(&tx_status_shm, &tx_status, sizeof(wifibroadcast_tx_status_t));
+}
+
+int
+inject_init(void)
+{
+	int result = 0;
+
+	do {
+		result = wfb_inject_init(inject_ports, INJECT_PORTS);
+		if (result != 0) {
+			break;
+		}
+
+		/* sent to the ground station by the rssi service */
+		if (!shm_map_init("shm_tx_status", sizeof(wifibroadcast_tx_status_t))) {
+			result = -1;
+			break;
+		}
+	} while (false);
+
+	return result;
+}
+
+int
+inject_main(void)
+{
+	static wfb_inject_t inj;
+
+	uint64_t last_update = 0ULL;
+
+	int result = wfb_inject_open(&inj, inject_ports, INJECT_PORTS);
+
+	if ((result == 0) && !shm_map_open("shm_tx_status", &tx_status_shm)) {
+		log_err("cannot open shm_tx_status");
+		result = -1;
+	}
+
+	if ((result == 0) && !shm_map_open("shm_video_tx_status", &video_tx_status_shm)) {
+		log_err("cannot open shm_video_tx_status");
+		result = -1;
+	}
+
+	while ((result == 0) && svc_cycle()) {
+		if (wfb_inject(&inj) < 0) {
+			result = -1;
+		}
+
+		if (inj.status.tx.last_update != last_update) {
+			last_update = inj.status.tx.last_update;
+			publish_tx_status(&inj);
+		}
+	}
+
+	return result;
+}
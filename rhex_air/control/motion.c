@@ -67,6 +67,9 @@ struct motion_data_t {
 
 #define FULL_CIRCLE (768.0f)
 #define TICKS (100)
+
+/* a gait step every tick, TICKS of them per cycle at full speed */
+#define STEP_PERIOD (10ULL * TIME_MS)
 #define MAX_SPEED (1536)
 
 #define PARKING_PHASE (0.25f)
@@ -385,19 +388,12 @@ parse_msg(const struct can_packet_t *msg)
 	}
 }
 
+/*
+ * Applied as soon as rc_main() publishes the command, not on the next step
+ */
 static void
-do_motion()
+do_command(const rc_data_t *rc_data)
 {
-	struct can_packet_t msg;
-
-	if (read_can_msg(&msg)) {
-		parse_msg(&msg);
-	}
-
-	void *p;
-	shm_map_read(&rc_shm, &p);
-	rc_data_t *rc_data = p;
-
 	if (rc_data->btn[0]) {
 		tgt_motion_state = MOTION_STATE_WALKING;
 	}
@@ -431,6 +427,19 @@ do_motion()
 			}
 		}
 	}
+}
+
+static void
+do_motion(const rc_data_t *rc_data)
+{
+	struct can_packet_t msg;
+
+	if (read_can_msg(&msg)) {
+		parse_msg(&msg);
+	}
+
+	/* the drivers may have just become ready */
+	do_command(rc_data);
 
 	switch (motion_state) {
 	case MOTION_STATE_OFF:
@@ -498,12 +507,43 @@ motion_main(void)
 		return 1;
 	}
 
-	shm_map_open("shm_rc", &rc_shm);
+	if (!shm_map_open("shm_rc", &rc_shm)) {
+		return 1;
+	}
 
 	start_msg();
 
+	rc_data_t rc_data;
+	uint32_t rc_index;
+	memset(&rc_data, 0, sizeof(rc_data));
+	shm_map_fetch(&rc_shm, &rc_data, sizeof(rc_data), &rc_index);
+
+	uint64_t next_step = svc_get_monotime();
+
 	while (svc_cycle()) {
-		do_motion();
+		uint64_t now = svc_get_monotime();
+		int timeout = 0;
+
+		if (next_step > now) {
+			timeout = (int)(((next_step - now) + TIME_MS - 1ULL) / TIME_MS);
+		}
+
+		/* a failed fetch keeps the last command */
+		if ((shm_map_wait(&rc_shm, rc_index, timeout) > 0) &&
+		    (shm_map_fetch(&rc_shm, &rc_data, sizeof(rc_data), &rc_index) == 0)) {
+			do_command(&rc_data);
+		}
+
+		now = svc_get_monotime();
+		if (now >= next_step) {
+			do_motion(&rc_data);
+
+			next_step += STEP_PERIOD;
+			if (next_step <= now) {
+				/* late by a whole step, do not catch up */
+				next_step = now + STEP_PERIOD;
+			}
+		}
 	}
 
 	return 0;
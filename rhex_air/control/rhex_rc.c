@@ -40,7 +40,7 @@ rc_main(void)
 	int result;
 
 	wfb_rx_t rc_rx = {
-	    0,
+	    .backend = WFB_RX_BACKEND_SHARED,
 	};
 
 	result = wfb_rx_init(&rc_rx, 30);
@@ -55,6 +55,7 @@ rc_main(void)
 		    0,
 		};
 
+		/* no period, the service sleeps here until a packet comes */
 		if (wfb_rx_packet(&rc_rx, &rx_data) > 0) {
 			struct _r {
 				uint32_t seqno;
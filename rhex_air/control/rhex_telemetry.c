@@ -20,66 +20,65 @@
 
 static shm_t gps_shm;
 static shm_t sensors_shm;
-static wfb_tx_t telemetry_tx;
+static wfb_tx_t telemetry_tx = {.backend = WFB_TX_BACKEND_QUEUE};
 
 #define X1E7 (10000000)
 
 static void
 read_gps_status(vector_telemetry_t *vot)
 {
-	gps_status_t *gps_status;
-	void *p;
+	gps_status_t gps_status;
 
-	shm_map_read(&gps_shm, &p);
-	gps_status = p;
+	if (shm_map_fetch(&gps_shm, &gps_status, sizeof(gps_status), NULL) < 0) {
+		return;
+	}
 
 	float conv;
-	conv = gps_status->latitude;
+	conv = gps_status.latitude;
 	vot->LatitudeX1E7 = (int32_t)(conv * X1E7);
 
-	conv = gps_status->longitude;
+	conv = gps_status.longitude;
 	vot->LongitudeX1E7 = (int32_t)(conv * X1E7);
 
-	conv = gps_status->speed;
+	conv = gps_status.speed;
 	vot->GroundspeedKPHX10 = (uint16_t)(conv * 10.0);
 
-	conv = gps_status->course;
+	conv = gps_status.course;
 	vot->CourseDegreesX10 = (uint16_t)(conv * 10.0);
 
-	conv = gps_status->altitude;
+	conv = gps_status.altitude;
 	vot->GPSAltitudecm = (int32_t)(conv * 100.0);
 
-	conv = gps_status->hdop;
+	conv = gps_status.hdop;
 	vot->HDOPx10 = (uint8_t)(conv * 10.0);
 
-	vot->SatsInUse = gps_status->sats_use;
+	vot->SatsInUse = gps_status.sats_use;
 }
 
 static void
 read_sensors_status(vector_telemetry_t *vot)
 {
-	union {
-		sensors_status_t *s;
-		void *p;
-	} p;
+	sensors_status_t s;
 
-	shm_map_read(&sensors_shm, &p.p);
+	if (shm_map_fetch(&sensors_shm, &s, sizeof(s), NULL) < 0) {
+		return;
+	}
 
 	float conv;
-	conv = p.s->angle_x;
+	conv = s.angle_x;
 	vot->PitchDegrees = (int16_t)(conv * 10.0);
-	conv = p.s->angle_y;
+	conv = s.angle_y;
 	vot->RollDegrees = (int16_t)(conv * 10.0);
-	conv = p.s->angle_z;
+	conv = s.angle_z;
 	vot->YawDegrees = (int16_t)(conv * 10.0);
 
-	conv = p.s->vbat;
+	conv = s.vbat;
 	vot->PackVoltageX100 = (uint16_t)(conv * 100.0);
 
-	conv = p.s->curr;
+	conv = s.curr;
 	vot->PackCurrentX100 = (uint16_t)(conv * 1000.0);
 
-	conv = p.s->pwr;
+	conv = s.pwr;
 	vot->mAHConsumed = conv;
 }
 
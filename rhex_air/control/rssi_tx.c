@@ -18,12 +18,12 @@
 #include <private/rssi_tx.h>
 
 typedef struct {
-	wifibroadcast_rx_status_t *rx_status;
-	wifibroadcast_rx_status_t_rc *rx_status_rc;
-	wifibroadcast_tx_status_t *tx_status;
+	wifibroadcast_rx_status_t rx_status;
+	wifibroadcast_rx_status_t_rc rx_status_rc;
+	wifibroadcast_tx_status_t tx_status;
 } telemetry_data_t;
 
-static wfb_tx_t wfb_rssi_tx;
+static wfb_tx_t wfb_rssi_tx = {.backend = WFB_TX_BACKEND_QUEUE};
 
 static shm_t rx_status_shm;
 static shm_t rx_status_rc_shm;
@@ -87,16 +87,16 @@ send_rssi(const telemetry_data_t *td)
 	int best_dbm = -127;
 	int best_dbm_rc = -127;
 	uint32_t c = 0;
-	uint32_t number_cards = td->rx_status->wifi_adapter_cnt;
-	uint32_t number_cards_rc = td->rx_status_rc->wifi_adapter_cnt;
+	uint32_t number_cards = td->rx_status.wifi_adapter_cnt;
+	uint32_t number_cards_rc = td->rx_status_rc.wifi_adapter_cnt;
 
 	bool no_signal = true;
 	bool no_signal_rc = true;
 
 	for (c = 0; c < number_cards; c++) {
-		if (td->rx_status->adapter[c].signal_good == 1) {
-			if (best_dbm < td->rx_status->adapter[c].current_signal_dbm) {
-				best_dbm = td->rx_status->adapter[c].current_signal_dbm;
+		if (td->rx_status.adapter[c].signal_good == 1) {
+			if (best_dbm < td->rx_status.adapter[c].current_signal_dbm) {
+				best_dbm = td->rx_status.adapter[c].current_signal_dbm;
 			}
 
 			no_signal = false;
@@ -104,9 +104,9 @@ send_rssi(const telemetry_data_t *td)
 	}
 
 	for (c = 0; c < number_cards_rc; c++) {
-		if (td->rx_status_rc->adapter[c].signal_good == 1) {
-			if (best_dbm_rc < td->rx_status_rc->adapter[c].current_signal_dbm) {
-				best_dbm_rc = td->rx_status_rc->adapter[c].current_signal_dbm;
+		if (td->rx_status_rc.adapter[c].signal_good == 1) {
+			if (best_dbm_rc < td->rx_status_rc.adapter[c].current_signal_dbm) {
+				best_dbm_rc = td->rx_status_rc.adapter[c].current_signal_dbm;
 			}
 
 			no_signal_rc = false;
@@ -125,12 +125,12 @@ send_rssi(const telemetry_data_t *td)
 		rssi_data.signal_rc = best_dbm_rc;
 	}
 
-	rssi_data.lostpackets = td->rx_status->lost_packet_cnt;
-	rssi_data.lostpackets_rc = td->rx_status_rc->lost_packet_cnt;
-	rssi_data.injected_block_cnt = td->tx_status->injected_block_cnt;
-	rssi_data.skipped_fec_cnt = td->tx_status->skipped_fec_cnt;
-	rssi_data.injection_fail_cnt = td->tx_status->injection_fail_cnt;
-	rssi_data.injection_time_block = td->tx_status->injection_time_block;
+	rssi_data.lostpackets = td->rx_status.lost_packet_cnt;
+	rssi_data.lostpackets_rc = td->rx_status_rc.lost_packet_cnt;
+	rssi_data.injected_block_cnt = td->tx_status.injected_block_cnt;
+	rssi_data.skipped_fec_cnt = td->tx_status.skipped_fec_cnt;
+	rssi_data.injection_fail_cnt = td->tx_status.injection_fail_cnt;
+	rssi_data.injection_time_block = td->tx_status.injection_time_block;
 
 	rssi_data.cpuload = get_cpuload();
 	rssi_data.temp = get_cputemp();
@@ -145,12 +145,13 @@ send_rssi(const telemetry_data_t *td)
 	return 0;
 }
 
-static void
+static bool
 telemetry_read(telemetry_data_t *td)
 {
-	shm_map_read(&rx_status_shm, (void **)&td->rx_status);
-	shm_map_read(&rx_status_rc_shm, (void **)&td->rx_status_rc);
-	shm_map_read(&tx_status_shm, (void **)&td->tx_status);
+	return (shm_map_fetch(&rx_status_shm, &td->rx_status, sizeof(td->rx_status), NULL) == 0) &&
+	       (shm_map_fetch(&rx_status_rc_shm, &td->rx_status_rc, sizeof(td->rx_status_rc),
+			      NULL) == 0) &&
+	       (shm_map_fetch(&tx_status_shm, &td->tx_status, sizeof(td->tx_status), NULL) == 0);
 }
 
 int
@@ -177,8 +178,9 @@ rssi_tx_main(void)
 		telemetry_data_t td;
 
 		while (svc_cycle()) {
-			telemetry_read(&td);
-			send_rssi(&td);
+			if (telemetry_read(&td)) {
+				send_rssi(&td);
+			}
 		}
 	} while (false);
 
@@ -0,0 +1,11 @@
+/**
+ * @file fec_feedback.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Прием статистики потерь видеопотока с наземной станции
+ */
+
+int fec_feedback_init(void);
+
+int fec_feedback_main(void);
@@ -17,6 +17,9 @@
 #include <wfb/wfb_status.h>
 
 #include <private/camera.h>
+#include <private/capture.h>
+#include <private/fec_feedback.h>
+#include <private/inject.h>
 #include <private/gps.h>
 #include <private/motion.h>
 #include <private/rhex_rc.h>
@@ -101,14 +104,17 @@ start_microservices(void)
 		svc_desc_t svc[SERVICES_MAX];
 		size_t count;
 	} svc_start_list = {
-	    {{"gps", gps_init, gps_main, 0ULL},
+	    {{"capture", capture_init, capture_main, 0ULL},
+	     {"inject", inject_init, inject_main, 0ULL},
+	     {"gps", gps_init, gps_main, 0ULL},
 	     {"sensors", sensors_init, sensors_main, 50ULL * TIME_MS},
-	     {"motion", motion_init, motion_main, 10ULL * TIME_MS},
+	     {"motion", motion_init, motion_main, 0ULL},
 	     {"telemetry", rhex_telemetry_init, rhex_telemetry_main, 100ULL * TIME_MS},
-	     {"rc", rc_init, rc_main, 30ULL * TIME_MS},
+	     {"rc", rc_init, rc_main, 0ULL},
 	     {"rssi", rssi_tx_init, rssi_tx_main, (1ULL * TIME_S) / 3ULL},
+	     {"fec feedback", fec_feedback_init, fec_feedback_main, 0ULL},
 	     {"camera", camera_init, camera_main, 0ULL}},
-	    7U};
+	    10U};
 
 	size_t i;
 
@@ -0,0 +1,72 @@
+/**
+ * @file fec_feedback.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Передача статистики потерь видеопотока на борт
+ */
+
+#include <string.h>
+
+#include <log/log.h>
+#include <svc/sharedmem.h>
+#include <svc/svc.h>
+#include <wfb/wfb_fec_ctl.h>
+#include <wfb/wfb_status.h>
+#include <wfb/wfb_tx.h>
+
+#include <private/fec_feedback.h>
+
+static wfb_tx_t feedback_tx = {.backend = WFB_TX_BACKEND_QUEUE};
+
+static shm_t rx_status_shm;
+
+int
+fec_feedback_init(void)
+{
+	return 0;
+}
+
+int
+fec_feedback_main(void)
+{
+	int result = 0;
+
+	do {
+		result = wfb_tx_init(&feedback_tx, WFB_FEC_FEEDBACK_PORT, false);
+		if (result != 0) {
+			break;
+		}
+
+		/* video rx status, see wfb_rx_stream_init() */
+		if (!shm_map_open("shm_rx_status", &rx_status_shm)) {
+			log_err("cannot open shm_rx_status");
+			result = 1;
+			break;
+		}
+
+		wfb_fec_feedback_t fb;
+		memset(&fb, 0, sizeof(fb));
+
+		while (svc_cycle()) {
+			wifibroadcast_rx_status_t rx_status;
+
+			if (shm_map_fetch(&rx_status_shm, &rx_status, sizeof(rx_status), NULL) <
+			    0) {
+				continue;
+			}
+
+			fb.seqno++;
+			fb.received_block_cnt = rx_status.received_block_cnt;
+			fb.damaged_block_cnt = rx_status.damaged_block_cnt;
+			fb.lost_packet_cnt = rx_status.lost_packet_cnt;
+			fb.received_packet_cnt = rx_status.received_packet_cnt;
+			fb.lost_per_block_cnt = rx_status.lost_per_block_cnt;
+			fb.tx_restart_cnt = rx_status.tx_restart_cnt;
+
+			wfb_tx_send_raw(&feedback_tx, (uint8_t *)&fb, sizeof(fb));
+		}
+	} while (false);
+
+	return result;
+}
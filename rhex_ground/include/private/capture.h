@@ -0,0 +1,11 @@
+/**
+ * @file capture.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Прием с адаптеров для всех сервисов наземной станции
+ */
+
+int capture_init(void);
+
+int capture_main(void);
@@ -0,0 +1,11 @@
+/**
+ * @file inject.h
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Отправка через адаптеры для всех сервисов наземной станции
+ */
+
+int inject_init(void);
+
+int inject_main(void);
@@ -0,0 +1,48 @@
+/**
+ * @file inject.c
+ * @author Алексей Хохлов <root@amper.me>
+ * @copyright WTFPL License
+ * @date 2021
+ * @brief Отправка через адаптеры для всех сервисов наземной станции
+ */
+
+#include <svc/svc.h>
+#include <wfb/wfb_fec_ctl.h>
+#include <wfb/wfb_inject.h>
+
+#include <private/inject.h>
+
+/*
+ * Every adapter is written from here only, the services queue their frames by port. The
+ * ports are in order of priority. A queue has a single writer, so every sending service
+ * owns its port
+ */
+static const wfb_inject_port_t inject_ports[] = {
+    {.port = 1, .slots = 64U},				/* rc */
+    {.port = 2, .slots = 64U},				/* control */
+    {.port = WFB_FEC_FEEDBACK_PORT, .slots = 64U}, /* fec feedback */
+};
+
+#define INJECT_PORTS (sizeof(inject_ports) / sizeof(inject_ports[0]))
+
+int
+inject_init(void)
+{
+	return wfb_inject_init(inject_ports, INJECT_PORTS);
+}
+
+int
+inject_main(void)
+{
+	static wfb_inject_t inj;
+
+	int result = wfb_inject_open(&inj, inject_ports, INJECT_PORTS);
+
+	while ((result == 0) && svc_cycle()) {
+		if (wfb_inject(&inj) < 0) {
+			result = -1;
+		}
+	}
+
+	return result;
+}
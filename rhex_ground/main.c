@@ -26,6 +26,9 @@
 #include <svc/timerfd.h>
 #include <wfb/wfb_status.h>
 
+#include <private/capture.h>
+#include <private/fec_feedback.h>
+#include <private/inject.h>
 #include <private/qgc_forward.h>
 #include <private/rhex_control.h>
 #include <private/rhex_telemetry_rx.h>
@@ -109,13 +112,17 @@ start_microservices(void)
 	static const struct {
 		svc_desc_t svc[SERVICES_MAX];
 		size_t count;
-	} svc_start_list = {{{"rssi", rssi_rx_init, rssi_rx_main, 100ULL * TIME_MS},
+	} svc_start_list = {{{"capture", capture_init, capture_main, 0ULL},
+			     {"inject", inject_init, inject_main, 0ULL},
+			     {"rssi", rssi_rx_init, rssi_rx_main, 100ULL * TIME_MS},
 			     {"telemetry", telemetry_rx_init, telemetry_rx_main, 10ULL * TIME_MS},
 			     {"rssi qgc", rssi_qgc_init, rssi_qgc_main, 250ULL * TIME_MS},
 			     {"video", video_init, video_main, 0ULL},
 			     {"rc_tx", rhex_tx_rc_init, rhex_tx_rc_main, 0ULL},
-			     {"control", rhex_control_init, rhex_control_main, 0ULL}},
-			    6U};
+			     {"control", rhex_control_init, rhex_control_main, 0ULL},
+			     {"fec feedback", fec_feedback_init, fec_feedback_main,
+			      100ULL * TIME_MS}},
+			    9U};
 
 	size_t i;
 
@@ -33,10 +33,10 @@ static shm_t rx_status_uplink_shm;
 static shm_t rx_status_rc_shm;
 static shm_t rx_status_sysair_shm;
 
-static wifibroadcast_rx_status_t *rx_status;
-static wifibroadcast_rx_status_t *rx_status_uplink;
-static wifibroadcast_rx_status_t_rc *rx_status_rc;
-static wifibroadcast_rx_status_t_sysair *rx_status_sysair;
+static wifibroadcast_rx_status_t rx_status;
+static wifibroadcast_rx_status_t rx_status_uplink;
+static wifibroadcast_rx_status_t_rc rx_status_rc;
+static wifibroadcast_rx_status_t_sysair rx_status_sysair;
 
 static uint8_t
 get_cpuload(void)
@@ -158,34 +158,36 @@ rssi_qgc_main(void)
 
 	while (svc_cycle()) {
 		/* читаем состояния */
-		shm_map_read(&rx_status_shm, (void **)&rx_status);
-		shm_map_read(&rx_status_uplink_shm, (void **)&rx_status_uplink);
-		shm_map_read(&rx_status_rc_shm, (void **)&rx_status_rc);
-		shm_map_read(&rx_status_sysair_shm, (void **)&rx_status_sysair);
+		shm_map_fetch(&rx_status_shm, &rx_status, sizeof(rx_status), NULL);
+		shm_map_fetch(&rx_status_uplink_shm, &rx_status_uplink, sizeof(rx_status_uplink),
+			      NULL);
+		shm_map_fetch(&rx_status_rc_shm, &rx_status_rc, sizeof(rx_status_rc), NULL);
+		shm_map_fetch(&rx_status_sysair_shm, &rx_status_sysair, sizeof(rx_status_sysair),
+			      NULL);
 
-		size_t number_cards = rx_status->wifi_adapter_cnt;
+		size_t number_cards = rx_status.wifi_adapter_cnt;
 
 		/* заполняем данные */
-		wbcdata.damaged_block_cnt = rx_status->damaged_block_cnt;
-		wbcdata.lost_packet_cnt = rx_status->lost_packet_cnt;
-		wbcdata.skipped_packet_cnt = rx_status_sysair->skipped_fec_cnt;
-		wbcdata.injection_fail_cnt = rx_status_sysair->injection_fail_cnt;
-		wbcdata.received_packet_cnt = rx_status->received_packet_cnt;
-		wbcdata.kbitrate = rx_status->kbitrate;
-
-		wbcdata.kbitrate_measured = rx_status_sysair->bitrate_measured_kbit;
-		wbcdata.kbitrate_set = rx_status_sysair->bitrate_kbit;
+		wbcdata.damaged_block_cnt = rx_status.damaged_block_cnt;
+		wbcdata.lost_packet_cnt = rx_status.lost_packet_cnt;
+		wbcdata.skipped_packet_cnt = rx_status_sysair.skipped_fec_cnt;
+		wbcdata.injection_fail_cnt = rx_status_sysair.injection_fail_cnt;
+		wbcdata.received_packet_cnt = rx_status.received_packet_cnt;
+		wbcdata.kbitrate = rx_status.kbitrate;
+
+		wbcdata.kbitrate_measured = rx_status_sysair.bitrate_measured_kbit;
+		wbcdata.kbitrate_set = rx_status_sysair.bitrate_kbit;
 		wbcdata.lost_packet_cnt_telemetry_up = 0;
 		/*wbcdata.lost_packet_cnt_telemetry_down = t_tdown->lost_packet_cnt;*/
 		wbcdata.lost_packet_cnt_msp_up = 0;
 		wbcdata.lost_packet_cnt_msp_down = 0;
-		wbcdata.lost_packet_cnt_rc = rx_status_rc->lost_packet_cnt;
+		wbcdata.lost_packet_cnt_rc = rx_status_rc.lost_packet_cnt;
 		/* RC uplink signal level */
 		int8_t dbm = -127;
 		size_t i;
 		for (i = 0U; i < number_cards; i++) {
-			if (rx_status_rc->adapter[i].current_signal_dbm > dbm) {
-				dbm = rx_status_rc->adapter[i].current_signal_dbm;
+			if (rx_status_rc.adapter[i].current_signal_dbm > dbm) {
+				dbm = rx_status_rc.adapter[i].current_signal_dbm;
 			}
 		}
 		wbcdata.current_signal_joystick_uplink = dbm;
@@ -242,27 +244,27 @@ rssi_qgc_main(void)
 
 		wbcdata.cpuload_gnd = get_cpuload();
 		wbcdata.temp_gnd = get_cputemp();
-		wbcdata.cpuload_air = rx_status_sysair->cpuload;
+		wbcdata.cpuload_air = rx_status_sysair.cpuload;
 
 		wbcdata.vbat_capacity = vbat_cap;
 		wbcdata.is_charging = is_charging;
 		wbcdata.vbat_gnd_mv = vbat_gnd;
 
-		wbcdata.temp_air = rx_status_sysair->temp;
-		wbcdata.wifi_adapter_cnt = rx_status->wifi_adapter_cnt;
+		wbcdata.temp_air = rx_status_sysair.temp;
+		wbcdata.wifi_adapter_cnt = rx_status.wifi_adapter_cnt;
 
 		size_t c;
 		for (c = 0; c < number_cards; c++) {
-			if (rx_status->adapter[c].signal_good > 0) {
+			if (rx_status.adapter[c].signal_good > 0) {
 				wbcdata.adapter[c].current_signal_dbm =
-				    rx_status->adapter[c].current_signal_dbm;
+				    rx_status.adapter[c].current_signal_dbm;
 			} else {
 				wbcdata.adapter[c].current_signal_dbm = -127;
 			}
 			wbcdata.adapter[c].received_packet_cnt =
-			    rx_status->adapter[c].received_packet_cnt;
-			wbcdata.adapter[c].type = rx_status->adapter[c].type;
-			wbcdata.adapter[c].signal_good = rx_status->adapter[c].signal_good;
+			    rx_status.adapter[c].received_packet_cnt;
+			wbcdata.adapter[c].type = rx_status.adapter[c].type;
+			wbcdata.adapter[c].signal_good = rx_status.adapter[c].signal_good;
 		}
 
 		if (sendto(s_rssi, &wbcdata, sizeof(wifibroadcast_rx_status_forward_t), 0,
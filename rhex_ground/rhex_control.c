@@ -20,7 +20,7 @@
 
 #define PORT (5761)
 
-static wfb_tx_t rc_tx;
+static wfb_tx_t rc_tx = {.backend = WFB_TX_BACKEND_QUEUE};
 
 static uint8_t mavlink_tx_seq;
 
@@ -172,7 +172,7 @@ rhex_control_main(void)
 			break;
 		}
 
-		result = wfb_tx_init(&rc_tx, 1, false);
+		result = wfb_tx_init(&rc_tx, 2, false);
 		if (result != 0) {
 			break;
 		}
@@ -155,7 +155,7 @@ telemetry_rx_main(void)
 	}
 
 	wfb_rx_t telemetry_rx = {
-	    0,
+	    .backend = WFB_RX_BACKEND_SHARED,
 	};
 
 	result = wfb_rx_init(&telemetry_rx, 1);
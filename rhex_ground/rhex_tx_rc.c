@@ -19,7 +19,7 @@
 
 #define PORT (5565)
 
-static wfb_tx_t rc_tx;
+static wfb_tx_t rc_tx = {.backend = WFB_TX_BACKEND_QUEUE};
 
 int
 rhex_tx_rc_init(void)
@@ -129,7 +129,7 @@ rssi_rx_main(void)
 	log_inf("RSSI RX started");
 
 	wfb_rx_t rssi_rx = {
-	    0,
+	    .backend = WFB_RX_BACKEND_SHARED,
 	};
 
 	int result = 0;
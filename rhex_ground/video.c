@@ -126,10 +126,28 @@ gstreamer_start(gst_desc_t *gst_desc)
 	return result;
 }
 
+/*
+ * Decoded packets go to gstreamer as they come, there is nothing to gather them into
+ */
+static void
+video_sink(void *arg, const wfb_rx_stream_data_t *packet)
+{
+	gst_desc_t *gst = (gst_desc_t *)arg;
+
+	ssize_t r = write(gst->stdin_fds[1], packet->data, packet->len);
+	(void)r;
+}
+
 int
 video_init(void)
 {
-	int result = wfb_rx_stream_init(&stream, 0);
+	wfb_rx_stream_cfg_t cfg = WFB_RX_STREAM_CFG_DEFAULT;
+
+	cfg.low_latency = true;
+	/* the capture service has the adapters */
+	cfg.backend = WFB_RX_BACKEND_SHARED;
+
+	int result = wfb_rx_stream_init(&stream, 0, &cfg);
 
 	return result;
 }
@@ -144,16 +162,10 @@ video_main(void)
 
 	gstreamer_start(&gst);
 
+	wfb_rx_stream_sink(&stream, video_sink, &gst);
+
 	while (svc_cycle()) {
-		wfb_rx_stream_packet_t rx_data;
-		rx_data.bytes = 0;
-		wfb_rx_stream(&stream, &rx_data);
-
-		if (rx_data.bytes > 0) {
-			int r;
-			r = write(gst.stdin_fds[1], rx_data.data, (size_t)rx_data.bytes);
-			(void)r;
-		}
+		wfb_rx_stream(&stream);
 	}
 
 	log_dbg("video exit");